@@ -0,0 +1,233 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_BENCH_H_
+#define LVFS_BENCH_H_
+
+#include <lvfs/IStream>
+#include <lvfs/IDescriptor>
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fcntl.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+/*
+ * Helpers shared by the benchmarks. They are plain programs, the
+ * numbers are printed and depend on the machine and the filesystem
+ * of the working directory (argv[1], the current one by default).
+ */
+namespace LVFS {
+namespace Bench {
+
+/** Seconds on the monotonic clock. */
+inline double now()
+{
+    struct timespec time;
+    ::clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+inline double megabytes(double bytes, double seconds)
+{
+    return seconds > 0 ? bytes / (1024 * 1024) / seconds : 0;
+}
+
+/** Local file, as streams of the local plugin are. */
+class File : public Implements<IStream, IDescriptor>
+{
+public:
+    File(const char *path, int flags) :
+        m_fd(::open(path, flags | O_CLOEXEC, 0644))
+    {
+        if (m_fd == -1)
+            m_lastError = Error(errno);
+    }
+
+    virtual ~File()
+    {
+        if (m_fd != -1)
+            ::close(m_fd);
+    }
+
+    inline bool isValid() const { return m_fd != -1; }
+
+    virtual size_t read(void *buffer, size_t size)
+    {
+        ssize_t res = ::read(m_fd, buffer, size);
+
+        if (res < 0)
+        {
+            m_lastError = Error(errno);
+            return 0;
+        }
+
+        return res;
+    }
+
+    virtual size_t write(const void *buffer, size_t size)
+    {
+        ssize_t res = ::write(m_fd, buffer, size);
+
+        if (res < 0)
+        {
+            m_lastError = Error(errno);
+            return 0;
+        }
+
+        return res;
+    }
+
+    virtual bool advise(off64_t offset, off64_t len, Advise advise)
+    {
+        return true;
+    }
+
+    virtual bool seek(off64_t offset, Whence whence)
+    {
+        static const int whences[] = { SEEK_SET, SEEK_CUR, SEEK_END };
+
+        if (::lseek64(m_fd, offset, whences[whence]) < 0)
+        {
+            m_lastError = Error(errno);
+            return false;
+        }
+
+        return true;
+    }
+
+    virtual bool flush()
+    {
+        return true;
+    }
+
+    virtual const Error &lastError() const
+    {
+        return m_lastError;
+    }
+
+    virtual int descriptor() const
+    {
+        return m_fd;
+    }
+
+private:
+    int m_fd;
+    Error m_lastError;
+};
+
+/** Hides IDescriptor of \a original, so that only IStream is left. */
+class Plain : public Implements<IStream>
+{
+public:
+    Plain(const Interface::Holder &original) :
+        m_original(original),
+        m_stream(original->as<IStream>())
+    {}
+
+    virtual size_t read(void *buffer, size_t size) { return m_stream->read(buffer, size); }
+    virtual size_t write(const void *buffer, size_t size) { return m_stream->write(buffer, size); }
+    virtual bool advise(off64_t offset, off64_t len, Advise advise) { return m_stream->advise(offset, len, advise); }
+    virtual bool seek(off64_t offset, Whence whence) { return m_stream->seek(offset, whence); }
+    virtual bool flush() { return m_stream->flush(); }
+    virtual const Error &lastError() const { return m_stream->lastError(); }
+
+private:
+    Interface::Holder m_original;
+    IStream *m_stream;
+};
+
+/** File of \a size random bytes. */
+inline bool makeFile(const char *path, off64_t size)
+{
+    static const size_t BufferSize = 1024 * 1024;
+    char *buffer = static_cast<char *>(::malloc(BufferSize));
+    bool res = buffer != NULL;
+    size_t len;
+    int fd;
+
+    if (!res || (fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1)
+    {
+        ::free(buffer);
+        return false;
+    }
+
+    for (off64_t i = 0; i < size && i < static_cast<off64_t>(BufferSize); ++i)
+        buffer[i] = ::rand();
+
+    for (; res && size > 0; size -= len)
+    {
+        len = size < static_cast<off64_t>(BufferSize) ? size : BufferSize;
+        res = ::write(fd, buffer, len) == static_cast<ssize_t>(len);
+    }
+
+    ::close(fd);
+    ::free(buffer);
+    return res;
+}
+
+inline int removeOne(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+    ::remove(path);
+    return 0;
+}
+
+inline void removeTree(const char *path)
+{
+    ::nftw(path, removeOne, 64, FTW_DEPTH | FTW_PHYS);
+}
+
+/** Scratch directory under \a parent, removed by the destructor. */
+class Scratch
+{
+    PLATFORM_MAKE_NONCOPYABLE(Scratch)
+    PLATFORM_MAKE_NONMOVEABLE(Scratch)
+
+public:
+    Scratch(const char *parent)
+    {
+        if (std::snprintf(m_path, sizeof(m_path), "%s/lvfs_bench.XXXXXX", parent) >= static_cast<int>(sizeof(m_path)) ||
+            ::mkdtemp(m_path) == NULL)
+        {
+            m_path[0] = 0;
+        }
+    }
+
+    ~Scratch()
+    {
+        if (m_path[0] != 0)
+            removeTree(m_path);
+    }
+
+    inline bool isValid() const { return m_path[0] != 0; }
+    inline const char *path() const { return m_path; }
+
+private:
+    char m_path[4096];
+};
+
+}}
+
+#endif /* LVFS_BENCH_H_ */
@@ -0,0 +1,68 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_bench.h"
+
+#include <lvfs/Checksum>
+
+
+/*
+ * Hashes one buffer with every Checksum algorithm. No file is involved,
+ * the directory argument is not used.
+ */
+namespace {
+using namespace LVFS;
+
+const char *const Names[] = { "CRC32C", "xxHash64", "CRC32" };
+
+}
+
+
+int main(int argc, char *argv[])
+{
+    size_t size = (argc > 1 ? ::atoll(argv[1]) : 256) * 1024 * 1024;
+    char *buffer = static_cast<char *>(::malloc(size));
+
+    if (buffer == NULL)
+    {
+        ::perror("malloc");
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < size; ++i)
+        buffer[i] = ::rand();
+
+    std::printf("%zu MiB\n", size / (1024 * 1024));
+
+    for (Checksum::Algorithm algorithm : { Checksum::Crc32c, Checksum::XxHash64, Checksum::Crc32 })
+    {
+        Checksum checksum(algorithm);
+        double time = Bench::now();
+
+        checksum.update(buffer, size);
+        time = Bench::now() - time;
+
+        std::printf("%-9s %-14s %8.3f s %10.1f MB/s %016llx\n",
+                    Names[algorithm], Checksum::implementation(algorithm), time, Bench::megabytes(size, time),
+                    static_cast<unsigned long long>(checksum.value()));
+    }
+
+    ::free(buffer);
+    return EXIT_SUCCESS;
+}
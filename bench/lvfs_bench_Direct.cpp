@@ -0,0 +1,158 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_bench.h"
+
+#include <lvfs/copy/Engine>
+
+#include <sys/mman.h>
+
+
+/*
+ * Copies one file with Copy::Engine, with and without Options::direct,
+ * and tells how much of both files is left in the page cache. The
+ * source is dropped from the cache before each copy, its residency is
+ * measured then too, so that a cache which didn't let go of it doesn't
+ * pass for a copy which filled it.
+ */
+namespace {
+using namespace LVFS;
+
+void report(void *arg, off64_t processed)
+{}
+
+/* Percentage of the file in the page cache */
+double cached(const char *path)
+{
+    long page = ::sysconf(_SC_PAGESIZE);
+    unsigned char *pages;
+    struct stat st;
+    size_t count;
+    size_t res = 0;
+    void *map;
+    int fd;
+
+    if ((fd = ::open(path, O_RDONLY | O_CLOEXEC)) == -1)
+        return -1;
+
+    if (::fstat(fd, &st) != 0 || st.st_size == 0 ||
+        (map = ::mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+        ::close(fd);
+        return -1;
+    }
+
+    count = (st.st_size + page - 1) / page;
+
+    if ((pages = static_cast<unsigned char *>(::malloc(count))) != NULL && ::mincore(map, st.st_size, pages) == 0)
+        for (size_t i = 0; i < count; ++i)
+            res += pages[i] & 1;
+
+    ::free(pages);
+    ::munmap(map, st.st_size);
+    ::close(fd);
+
+    return res * 100.0 / count;
+}
+
+void drop(const char *path)
+{
+    int fd;
+
+    if ((fd = ::open(path, O_RDONLY | O_CLOEXEC)) != -1)
+    {
+        ::fdatasync(fd);
+        ::posix_fadvise64(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+}
+
+bool copy(const char *source, const char *destination, bool direct, off64_t size)
+{
+    static const volatile bool aborted = false;
+    const Copy::Statistics::Progress progress = { NULL, report, aborted };
+    Copy::Statistics statistics(progress);
+    Copy::Engine::Options options;
+    Bench::File *file;
+    double cold;
+
+    options.direct = direct;
+    Copy::Engine engine(statistics, options);
+
+    drop(source);
+    cold = cached(source);
+
+    Interface::Holder src(file = new (std::nothrow) Bench::File(source, O_RDONLY));
+
+    if (!file->isValid())
+        return false;
+
+    Interface::Holder dst(file = new (std::nothrow) Bench::File(destination, O_WRONLY | O_CREAT | O_TRUNC));
+
+    if (!file->isValid())
+        return false;
+
+    double time = Bench::now();
+
+    if (!engine.copy(src, dst) || ::fdatasync(file->descriptor()) != 0)
+    {
+        std::fprintf(stderr, "copy: %s\n", engine.lastError().description());
+        return false;
+    }
+
+    time = Bench::now() - time;
+    std::printf("%-8s %8.3f s %10.1f MB/s, cached: source %5.1f%% before, %5.1f%% after, destination %5.1f%%%s\n",
+                direct ? "direct" : "cached", time, Bench::megabytes(size, time), cold, cached(source), cached(destination),
+                direct && engine.method() != Copy::Engine::Direct ? " (O_DIRECT refused)" : "");
+    return true;
+}
+
+}
+
+
+int main(int argc, char *argv[])
+{
+    off64_t size = (argc > 2 ? ::atoll(argv[2]) : 256) * 1024 * 1024;
+    char source[4096];
+    char destination[4096];
+
+    Bench::Scratch scratch(argc > 1 ? argv[1] : ".");
+
+    if (!scratch.isValid())
+    {
+        ::perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    std::snprintf(source, sizeof(source), "%s/source", scratch.path());
+    std::snprintf(destination, sizeof(destination), "%s/destination", scratch.path());
+
+    if (!Bench::makeFile(source, size))
+    {
+        ::perror("source");
+        return EXIT_FAILURE;
+    }
+
+    std::printf("%lld MiB, copy and fdatasync()\n", static_cast<long long>(size / (1024 * 1024)));
+
+    if (!copy(source, destination, false, size) || !copy(source, destination, true, size))
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,129 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_bench_Local.h"
+
+#include <lvfs/copy/Job>
+
+
+/*
+ * Copies a directory of small files with Copy::Job once per durability
+ * policy, each time into a new destination.
+ */
+namespace {
+using namespace LVFS;
+
+enum
+{
+    Files = 2000,
+    FileSize = 16 * 1024
+};
+
+const char *const Policies[] = { "None", "PerFile", "Batched" };
+
+void report(void *arg, off64_t processed)
+{}
+
+bool copy(const char *parent, Copy::Job::Durability durability)
+{
+    static const volatile bool aborted = false;
+    const Copy::Job::Progress progress = { NULL, report, aborted };
+    Copy::Job::Options options;
+    Copy::Job::Files files;
+    char path[PATH_MAX];
+
+    std::snprintf(path, sizeof(path), "%s/%s", parent, Policies[durability]);
+
+    if (::mkdir(path, 0755) != 0)
+    {
+        ::perror("mkdir");
+        return false;
+    }
+
+    Interface::Holder destination = Bench::entry(path);
+    std::snprintf(path, sizeof(path), "%s/source", parent);
+    Interface::Holder source = Bench::entry(path);
+
+    for (auto i = source->as<IDirectory>()->begin(), end = source->as<IDirectory>()->end(); i != end; ++i)
+        files.push_back(*i);
+
+    options.durability = durability;
+    Copy::Job job(progress, source, files, destination, options);
+
+    /* Whatever the previous run left dirty is not this one's business */
+    ::sync();
+
+    double time = Bench::now();
+
+    if (!job.run())
+    {
+        std::fprintf(stderr, "%s: %s\n", Policies[durability], job.lastError().description());
+        return false;
+    }
+
+    time = Bench::now() - time;
+    std::printf("%-8s %8.3f s %10.1f files/s\n", Policies[durability], time, Files / time);
+    return true;
+}
+
+}
+
+
+int main(int argc, char *argv[])
+{
+    char path[PATH_MAX];
+
+    Bench::Scratch scratch(argc > 1 ? argv[1] : ".");
+
+    if (!scratch.isValid())
+    {
+        ::perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    std::snprintf(path, sizeof(path), "%s/source", scratch.path());
+
+    if (::mkdir(path, 0755) != 0)
+    {
+        ::perror("mkdir");
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < Files; ++i)
+    {
+        std::snprintf(path, sizeof(path), "%s/source/f%d", scratch.path(), i);
+
+        if (!Bench::makeFile(path, FileSize))
+        {
+            ::perror("source");
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::printf("%d files of %d KiB\n", Files, FileSize / 1024);
+
+    if (!copy(scratch.path(), Copy::Job::None) ||
+        !copy(scratch.path(), Copy::Job::PerFile) ||
+        !copy(scratch.path(), Copy::Job::Batched))
+    {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,151 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_bench.h"
+
+#include <lvfs/copy/Engine>
+
+
+/*
+ * Copies the same set of files with Copy::Engine once per method, each
+ * method forced by Engine::Options::methods. The sources are in the
+ * page cache after the first run, so the numbers tell the cost of
+ * moving the data, not the speed of the device.
+ */
+namespace {
+using namespace LVFS;
+
+enum
+{
+    Files = 16
+};
+
+struct Method
+{
+    Copy::Engine::Method method;
+    const char *name;
+};
+
+const Method Methods[] =
+{
+    { Copy::Engine::Reflink, "reflink" },
+    { Copy::Engine::CopyFileRange, "copy_file_range()" },
+    { Copy::Engine::SendFile, "sendfile()" },
+    { Copy::Engine::Splice, "splice()" },
+    { Copy::Engine::ReadWrite, "read()/write()" }
+};
+
+void report(void *arg, off64_t processed)
+{}
+
+/* False if the method is not supported, -1 seconds on other failures */
+bool copy(const char *directory, const Method &method, off64_t size, double &time)
+{
+    static const volatile bool aborted = false;
+    const Copy::Statistics::Progress progress = { NULL, report, aborted };
+    Copy::Statistics statistics(progress);
+    Copy::Engine::Options options;
+    char source[PATH_MAX];
+    char destination[PATH_MAX];
+    Bench::File *file;
+
+    options.methods = 1 << method.method;
+    Copy::Engine engine(statistics, options);
+
+    time = 0;
+
+    for (int i = 0; i < Files; ++i)
+    {
+        std::snprintf(source, sizeof(source), "%s/source%d", directory, i);
+        std::snprintf(destination, sizeof(destination), "%s/destination%d", directory, i);
+
+        Interface::Holder src(file = new (std::nothrow) Bench::File(source, O_RDONLY));
+
+        if (!file->isValid())
+        {
+            time = -1;
+            return true;
+        }
+
+        Interface::Holder dst(file = new (std::nothrow) Bench::File(destination, O_WRONLY | O_CREAT | O_TRUNC));
+
+        if (!file->isValid())
+        {
+            time = -1;
+            return true;
+        }
+
+        double start = Bench::now();
+
+        if (!engine.copy(src, dst))
+        {
+            if (engine.lastError().code() == ENOTSUP)
+                return false;
+
+            std::fprintf(stderr, "%s: %s\n", method.name, engine.lastError().description());
+            time = -1;
+            return true;
+        }
+
+        time += Bench::now() - start;
+    }
+
+    return true;
+}
+
+}
+
+
+int main(int argc, char *argv[])
+{
+    off64_t size = (argc > 2 ? ::atoll(argv[2]) : 256) * 1024 * 1024;
+    char path[PATH_MAX];
+    double time;
+
+    Bench::Scratch scratch(argc > 1 ? argv[1] : ".");
+
+    if (!scratch.isValid())
+    {
+        ::perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < Files; ++i)
+    {
+        std::snprintf(path, sizeof(path), "%s/source%d", scratch.path(), i);
+
+        if (!Bench::makeFile(path, size / Files))
+        {
+            ::perror("source");
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::printf("%d files, %lld MiB\n", Files, static_cast<long long>(size / (1024 * 1024)));
+
+    for (const Method &method : Methods)
+        if (!copy(scratch.path(), method, size, time))
+            std::printf("%-18s not supported\n", method.name);
+        else if (time < 0)
+            return EXIT_FAILURE;
+        else
+            std::printf("%-18s %8.3f s %10.1f MB/s\n", method.name, time, Bench::megabytes(size, time));
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,134 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_bench_Local.h"
+
+#include <lvfs/LazyType>
+#include <lvfs/settings/Instance>
+
+
+/*
+ * Lists a directory (argv[1], the current one by default) with LazyType
+ * and times every tier separately: getdents() and the types themselves,
+ * the MIME types by name and the content sniffing. Every tier is what a
+ * view pays for once it needs that much of the type.
+ */
+namespace {
+using namespace LVFS;
+
+struct Item
+{
+    Interface::Holder entry;
+    Interface::Holder type;
+};
+
+typedef ::EFC::List<Item> Items;
+
+double list(const char *path, Items &items)
+{
+    char buffer[PATH_MAX];
+    struct dirent *entry;
+    struct stat st;
+    unsigned char kind;
+    DIR *dir;
+
+    double time = Bench::now();
+
+    if ((dir = ::opendir(path)) == NULL)
+        return -1;
+
+    while ((entry = ::readdir(dir)) != NULL)
+    {
+        if (std::strcmp(entry->d_name, ".") == 0 || std::strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        if ((kind = entry->d_type) == DT_UNKNOWN)
+            kind = ::fstatat(::dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+
+        std::snprintf(buffer, sizeof(buffer), "%s/%s", path, entry->d_name);
+        Item item = { Bench::entry(buffer), Interface::Holder(new (std::nothrow) LazyType(entry->d_name, kind)) };
+
+        if (item.entry.isValid())
+            items.push_back(item);
+    }
+
+    ::closedir(dir);
+    return Bench::now() - time;
+}
+
+double byName(const Items &items)
+{
+    double time = Bench::now();
+
+    for (auto &i : items)
+        i.type->as<IType>()->name();
+
+    return Bench::now() - time;
+}
+
+double byContent(const Items &items)
+{
+    double time = Bench::now();
+
+    for (auto &i : items)
+        if (!i.type->as<LazyType>()->isDirectory())
+            i.type->as<LazyType>()->sniff(i.entry->as<IEntry>());
+
+    return Bench::now() - time;
+}
+
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : ".";
+    char file[PATH_MAX];
+    Items items;
+
+    Bench::Scratch scratch("/tmp");
+
+    if (!scratch.isValid())
+    {
+        ::perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    std::snprintf(file, sizeof(file), "%s/settings.xml", scratch.path());
+    Settings::Instance settings(file);
+    Module module(settings);
+
+    double kind = list(path, items);
+
+    if (kind < 0)
+    {
+        ::perror("opendir");
+        return EXIT_FAILURE;
+    }
+
+    double name = byName(items);
+    double content = byContent(items);
+
+    std::printf("%zu entries of %s\n", items.size(), path);
+    std::printf("kind:    %8.3f s\n", kind);
+    std::printf("name:    %8.3f s (%8.3f s in total)\n", name, kind + name);
+    std::printf("content: %8.3f s (%8.3f s in total)\n", content, kind + name + content);
+
+    return EXIT_SUCCESS;
+}
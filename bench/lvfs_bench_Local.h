@@ -0,0 +1,220 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_BENCH_LOCAL_H_
+#define LVFS_BENCH_LOCAL_H_
+
+#include "lvfs_bench.h"
+
+#include <lvfs/IEntry>
+#include <lvfs/IType>
+#include <lvfs/IProperties>
+#include <lvfs/IDirectory>
+#include <lvfs/Module>
+#include <efc/List>
+
+#include <cstring>
+#include <dirent.h>
+
+
+/*
+ * Bare local entries for the benchmarks which need IEntry and
+ * IDirectory, the local plugin is not part of this tree.
+ */
+namespace LVFS {
+namespace Bench {
+
+Interface::Holder entry(const char *path);
+
+class Entry : public Implements<IEntry, IType, IProperties>
+{
+public:
+    Entry(const char *path, const struct stat &st) :
+        m_st(st)
+    {
+        std::strncpy(m_location, path, sizeof(m_location) - 1);
+        m_location[sizeof(m_location) - 1] = 0;
+        m_title = std::strrchr(m_location, '/') + 1;
+    }
+
+    /* IEntry */
+
+    virtual const char *title() const { return m_title; }
+    virtual const char *schema() const { return "file"; }
+    virtual const char *location() const { return m_location; }
+    virtual const IType *type() const { return this; }
+
+    virtual Interface::Holder open(IStream::Mode mode = IStream::Read) const
+    {
+        static const int flags[] = { O_RDONLY, O_WRONLY | O_CREAT | O_TRUNC, O_RDWR | O_CREAT };
+        File *file = new (std::nothrow) File(m_location, flags[mode]);
+        Interface::Holder res(file);
+
+        if (file == NULL || !file->isValid())
+            return Interface::Holder();
+
+        return res;
+    }
+
+    /* IType */
+
+    virtual const char *name() const { return S_ISDIR(m_st.st_mode) ? Module::DirectoryTypeName : "application/octet-stream"; }
+    virtual Interface::Holder icon() const { return Interface::Holder(); }
+    virtual const char *description() const { return name(); }
+
+    /* IProperties */
+
+    virtual off64_t size() const { return m_st.st_size; }
+    virtual time_t cTime() const { return m_st.st_ctime; }
+    virtual time_t mTime() const { return m_st.st_mtime; }
+    virtual time_t aTime() const { return m_st.st_atime; }
+    virtual int permissions() const { return 0; }
+
+protected:
+    char m_location[PATH_MAX];
+    const char *m_title;
+    struct stat m_st;
+};
+
+class Directory : public Complements<Entry, IDirectory>
+{
+public:
+    Directory(const char *path, const struct stat &st) :
+        Complements<Entry, IDirectory>(path, st),
+        m_loaded(false)
+    {}
+
+    /* IDirectory */
+
+    virtual const_iterator begin() const { load(); return std_iterator<Entries>(m_entries.begin()); }
+    virtual const_iterator end() const { load(); return std_iterator<Entries>(m_entries.end()); }
+
+    virtual bool exists(const char *name) const
+    {
+        char buffer[PATH_MAX];
+        struct stat st;
+
+        return ::lstat(path(name, buffer), &st) == 0;
+    }
+
+    virtual Interface::Holder entry(const char *name, const IType *type = NULL, bool create = false)
+    {
+        char buffer[PATH_MAX];
+        const char *path = this->path(name, buffer);
+        int fd;
+
+        if (!create)
+            return Bench::entry(path);
+
+        if (type != NULL && std::strcmp(type->name(), Module::DirectoryTypeName) == 0)
+        {
+            if (::mkdir(path, 0755) != 0 && errno != EEXIST)
+            {
+                m_lastError = Error(errno);
+                return Interface::Holder();
+            }
+        }
+        else if ((fd = ::open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644)) == -1)
+        {
+            m_lastError = Error(errno);
+            return Interface::Holder();
+        }
+        else
+            ::close(fd);
+
+        return Bench::entry(path);
+    }
+
+    virtual bool copy(const Progress &callback, const Interface::Holder &file, bool move = false)
+    {
+        m_lastError = Error(ENOTSUP);
+        return false;
+    }
+
+    virtual bool rename(const Interface::Holder &file, const char *name)
+    {
+        char buffer[PATH_MAX];
+
+        if (::rename(file->as<IEntry>()->location(), path(name, buffer)) == 0)
+            return true;
+
+        m_lastError = Error(errno);
+        return false;
+    }
+
+    virtual bool remove(const Interface::Holder &file)
+    {
+        const IEntry *entry = file->as<IEntry>();
+
+        if (::remove(entry->location()) == 0)
+            return true;
+
+        m_lastError = Error(errno);
+        return false;
+    }
+
+    virtual const Error &lastError() const { return m_lastError; }
+
+private:
+    typedef ::EFC::List<Interface::Holder> Entries;
+
+    const char *path(const char *name, char (&buffer)[PATH_MAX]) const
+    {
+        std::snprintf(buffer, PATH_MAX, "%s/%s", m_location, name);
+        return buffer;
+    }
+
+    void load() const
+    {
+        char buffer[PATH_MAX];
+        struct dirent *entry;
+        DIR *dir;
+
+        if (m_loaded || (dir = ::opendir(m_location)) == NULL)
+            return;
+
+        while ((entry = ::readdir(dir)) != NULL)
+            if (std::strcmp(entry->d_name, ".") != 0 && std::strcmp(entry->d_name, "..") != 0)
+                m_entries.push_back(Bench::entry(path(entry->d_name, buffer)));
+
+        ::closedir(dir);
+        m_loaded = true;
+    }
+
+private:
+    mutable bool m_loaded;
+    mutable Entries m_entries;
+    Error m_lastError;
+};
+
+inline Interface::Holder entry(const char *path)
+{
+    struct stat st;
+
+    if (::lstat(path, &st) != 0)
+        return Interface::Holder();
+    else if (S_ISDIR(st.st_mode))
+        return Interface::Holder(new (std::nothrow) Directory(path, st));
+    else
+        return Interface::Holder(new (std::nothrow) Entry(path, st));
+}
+
+}}
+
+#endif /* LVFS_BENCH_LOCAL_H_ */
@@ -0,0 +1,127 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_bench.h"
+
+#include <lvfs/PathCache>
+
+#include <cstring>
+
+
+/*
+ * Opens every file of the bottom directory of a deep tree many times,
+ * with plain open() and through PathCache::open().
+ */
+namespace {
+using namespace LVFS;
+
+enum
+{
+    Depth = 20,
+    Files = 100,
+    Rounds = 2000
+};
+
+double openAll(const char *directory, bool cached)
+{
+    char path[4096];
+    double time = Bench::now();
+    int fd;
+
+    for (int round = 0; round < Rounds; ++round)
+        for (int i = 0; i < Files; ++i)
+        {
+            std::snprintf(path, sizeof(path), "%s/f%d", directory, i);
+
+            if ((fd = cached ? PathCache::open(path, O_RDONLY | O_CLOEXEC) : ::open(path, O_RDONLY | O_CLOEXEC)) == -1)
+                return -1;
+
+            ::close(fd);
+        }
+
+    return Bench::now() - time;
+}
+
+}
+
+
+int main(int argc, char *argv[])
+{
+    char parent[4096];
+    char directory[4096];
+    size_t len;
+
+    if (::realpath(argc > 1 ? argv[1] : ".", parent) == NULL)
+    {
+        ::perror("realpath");
+        return EXIT_FAILURE;
+    }
+
+    Bench::Scratch scratch(parent);
+
+    if (!scratch.isValid())
+    {
+        ::perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    len = std::snprintf(directory, sizeof(directory), "%s", scratch.path());
+
+    for (int i = 0; i < Depth; ++i)
+    {
+        len += std::snprintf(directory + len, sizeof(directory) - len, "/d%d", i);
+
+        if (::mkdir(directory, 0755) != 0)
+        {
+            ::perror("mkdir");
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (int i = 0; i < Files; ++i)
+    {
+        char path[4096];
+        std::snprintf(path, sizeof(path), "%s/f%d", directory, i);
+
+        if (!Bench::makeFile(path, 0))
+        {
+            ::perror("open");
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* A TTL longer than the run, so that only the first open misses */
+    PathCache::setTtl(60 * 1000);
+
+    double plain = openAll(directory, false);
+    double cached = openAll(directory, true);
+
+    if (plain < 0 || cached < 0)
+    {
+        ::perror("open");
+        return EXIT_FAILURE;
+    }
+
+    std::printf("%d opens at depth %d\n", Rounds * Files, Depth);
+    std::printf("open():            %.3f s\n", plain);
+    std::printf("PathCache::open(): %.3f s (hits %zu, misses %zu)\n", cached, PathCache::hits(), PathCache::misses());
+
+    PathCache::clear();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,233 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_copy_Devices.h"
+#include "lvfs_copy_Settings.h"
+
+#include <efc/Map>
+
+#include <cstdio>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+
+namespace LVFS {
+namespace Copy {
+
+namespace {
+
+    struct Device
+    {
+        Devices::Class type;
+        int active;
+    };
+
+    static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+    static pthread_cond_t s_released = PTHREAD_COND_INITIALIZER;
+    static ::EFC::Map<dev_t, Device> s_devices;
+
+
+    /* Partitions have no queue, so look at the whole disk too */
+    int readFlag(dev_t device, const char *name)
+    {
+        char path[128];
+        int res = -1;
+        FILE *file;
+
+        if (std::snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/%s", major(device), minor(device), name) < 0)
+            return -1;
+
+        if ((file = std::fopen(path, "r")) == NULL)
+        {
+            if (std::snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/../%s", major(device), minor(device), name) < 0 ||
+                (file = std::fopen(path, "r")) == NULL)
+            {
+                return -1;
+            }
+        }
+
+        if (std::fscanf(file, "%d", &res) != 1)
+            res = -1;
+
+        std::fclose(file);
+        return res;
+    }
+
+    Device &lookup(dev_t device)
+    {
+        auto i = s_devices.find(device);
+
+        if (i != s_devices.end())
+            return (*i).second;
+
+        Device &res = s_devices[device];
+        res.active = 0;
+
+        if (major(device) == 0)
+            res.type = Devices::Other;
+        else if (readFlag(device, "removable") == 1)
+            res.type = Devices::Removable;
+        else
+            switch (readFlag(device, "queue/rotational"))
+            {
+                case 0:
+                    res.type = Devices::SolidState;
+                    break;
+
+                case 1:
+                    res.type = Devices::Rotational;
+                    break;
+
+                default:
+                    res.type = Devices::Other;
+                    break;
+            }
+
+        return res;
+    }
+
+    int classLimit(Devices::Class type)
+    {
+        const Settings *settings = Settings::instance();
+        int res;
+
+        switch (type)
+        {
+            case Devices::Rotational:
+                res = settings ? settings->rotationalDeviceJobs() : Settings::DefaultRotationalDeviceJobs;
+                break;
+
+            case Devices::SolidState:
+                res = settings ? settings->solidStateDeviceJobs() : Settings::DefaultSolidStateDeviceJobs;
+                break;
+
+            case Devices::Removable:
+                res = settings ? settings->removableDeviceJobs() : Settings::DefaultRemovableDeviceJobs;
+                break;
+
+            default:
+                res = settings ? settings->otherDeviceJobs() : Settings::DefaultOtherDeviceJobs;
+                break;
+        }
+
+        return res > 0 ? res : 1;
+    }
+
+    inline bool available(dev_t device)
+    {
+        if (device == 0)
+            return true;
+
+        Device &dev = lookup(device);
+        return dev.active < classLimit(dev.type);
+    }
+
+    inline void acquire(dev_t device)
+    {
+        if (device != 0)
+            ++lookup(device).active;
+    }
+
+    inline void release(dev_t device)
+    {
+        if (device != 0)
+            --lookup(device).active;
+    }
+
+}
+
+
+Devices::Slot::Slot(dev_t source, dev_t destination) :
+    m_first(source),
+    m_second(source == destination ? 0 : destination)
+{
+    ::pthread_mutex_lock(&s_mutex);
+
+    /* Take both at once, so two jobs in opposite directions can't deadlock */
+    while (!available(m_first) || !available(m_second))
+        ::pthread_cond_wait(&s_released, &s_mutex);
+
+    acquire(m_first);
+    acquire(m_second);
+
+    ::pthread_mutex_unlock(&s_mutex);
+}
+
+Devices::Slot::~Slot()
+{
+    ::pthread_mutex_lock(&s_mutex);
+
+    release(m_first);
+    release(m_second);
+    ::pthread_cond_broadcast(&s_released);
+
+    ::pthread_mutex_unlock(&s_mutex);
+}
+
+dev_t Devices::device(int fd)
+{
+    struct stat st;
+
+    if (::fstat(fd, &st) == 0)
+        return st.st_dev;
+    else
+        return 0;
+}
+
+Devices::Class Devices::deviceClass(dev_t device)
+{
+    Class res;
+
+    ::pthread_mutex_lock(&s_mutex);
+    res = lookup(device).type;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return res;
+}
+
+int Devices::limit(dev_t device)
+{
+    int res;
+
+    if (device == 0)
+        return Unlimited;
+
+    ::pthread_mutex_lock(&s_mutex);
+    res = classLimit(lookup(device).type);
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return res;
+}
+
+int Devices::active(dev_t device)
+{
+    int res;
+
+    if (device == 0)
+        return 0;
+
+    ::pthread_mutex_lock(&s_mutex);
+    res = lookup(device).active;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return res;
+}
+
+}}
@@ -0,0 +1,83 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_COPY_DEVICES_H_
+#define LVFS_COPY_DEVICES_H_
+
+#include <climits>
+#include <sys/types.h>
+#include <platform/utils.h>
+
+
+namespace LVFS {
+namespace Copy {
+
+/**
+ * Process-wide limits of concurrent transfers per block device.
+ *
+ * Devices are identified by st_dev, the class of a device is read once
+ * from sysfs (queue/rotational and removable flags). Limits per class
+ * come from Copy::Settings, or built-in defaults if there is none.
+ * Device 0 stands for "unknown" and is never limited: its limit() is
+ * Unlimited and its active() is always 0.
+ */
+class PLATFORM_MAKE_PUBLIC Devices
+{
+public:
+    enum Class
+    {
+        Other,
+        Rotational,
+        SolidState,
+        Removable
+    };
+
+    enum
+    {
+        Unlimited = INT_MAX
+    };
+
+    /**
+     * Holds one transfer slot on the source and the destination devices,
+     * blocks in constructor until both are available.
+     */
+    class PLATFORM_MAKE_PUBLIC Slot
+    {
+        PLATFORM_MAKE_NONCOPYABLE(Slot)
+        PLATFORM_MAKE_NONMOVEABLE(Slot)
+
+    public:
+        Slot(dev_t source, dev_t destination);
+        ~Slot();
+
+    private:
+        dev_t m_first;
+        dev_t m_second;
+    };
+
+public:
+    static dev_t device(int fd);
+    static Class deviceClass(dev_t device);
+    static int limit(dev_t device);
+    static int active(dev_t device);
+};
+
+}}
+
+#endif /* LVFS_COPY_DEVICES_H_ */
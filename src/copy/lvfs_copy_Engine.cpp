@@ -0,0 +1,1043 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_copy_Engine.h"
+#include "lvfs_copy_Devices.h"
+
+#include <lvfs/IStream>
+#include <lvfs/IDescriptor>
+#include <lvfs/BufferPool>
+#include <brolly/assert.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+
+namespace LVFS {
+namespace Copy {
+
+namespace {
+
+    /* Errors which mean "try the next method", provided nothing was copied yet */
+    inline bool unsupported(int error)
+    {
+        return error == ENOSYS || error == EXDEV || error == EINVAL ||
+               error == EOPNOTSUPP || error == ENOTSUP || error == ENOTTY ||
+               error == EBADF || error == ETXTBSY;
+    }
+
+
+    inline bool isZero(const char *data, size_t size)
+    {
+        return data[0] == 0 && ::memcmp(data, data + 1, size - 1) == 0;
+    }
+
+    /* Length of the leading run of ZeroBlockSize blocks which are all zero or all not */
+    size_t zeroRun(const char *data, size_t size, bool &zero)
+    {
+        size_t block = std::min<size_t>(size, Engine::ZeroBlockSize);
+        size_t res = block;
+
+        for (zero = isZero(data, block); res < size; res += block)
+        {
+            block = std::min<size_t>(size - res, Engine::ZeroBlockSize);
+
+            if (isZero(data + res, block) != zero)
+                break;
+        }
+
+        return res;
+    }
+
+    bool writePositional(int fd, const char *buffer, size_t size, off64_t offset)
+    {
+        ssize_t written;
+
+        for (size_t done = 0; done < size; done += written)
+            if ((written = ::pwrite64(fd, buffer + done, size - done, offset + done)) < 0)
+                if (errno == EINTR)
+                    written = 0;
+                else
+                    return false;
+
+        return true;
+    }
+
+    /* Moves what splice() left in a pipe by read()/write() */
+    bool drain(int pipe, int destination, size_t size)
+    {
+        char buffer[PIPE_BUF];
+        ssize_t read;
+        ssize_t written;
+
+        while (size > 0)
+        {
+            if ((read = ::read(pipe, buffer, std::min(size, sizeof(buffer)))) <= 0)
+                if (read < 0 && errno == EINTR)
+                    continue;
+                else
+                    return false;
+
+            for (ssize_t done = 0; done < read; done += written)
+                if ((written = ::write(destination, buffer + done, read - done)) < 0)
+                    if (errno == EINTR)
+                        written = 0;
+                    else
+                        return false;
+
+            size -= read;
+        }
+
+        return true;
+    }
+
+    bool writeSparse(int fd, const char *buffer, size_t size, off64_t offset)
+    {
+        bool zero;
+
+        for (size_t run; size > 0; buffer += run, offset += run, size -= run)
+            if ((run = zeroRun(buffer, size, zero)) && !zero && !writePositional(fd, buffer, run, offset))
+                return false;
+
+        return true;
+    }
+
+
+    struct Chunks
+    {
+        pthread_mutex_t mutex;
+        pthread_cond_t finished;
+        Statistics *statistics;
+        int source;
+        int destination;
+        off64_t sourceOffset;
+        off64_t destinationOffset;
+        off64_t size;
+        off64_t next;
+        off64_t copied;
+        size_t chunkSize;
+        size_t bufferSize;
+        int running;
+        int error;
+    };
+
+    bool fetchChunk(Chunks &chunks, off64_t &offset, off64_t &end)
+    {
+        bool res = false;
+        ::pthread_mutex_lock(&chunks.mutex);
+
+        if (chunks.error == 0 && !chunks.statistics->aborted() && chunks.next < chunks.size)
+        {
+            offset = chunks.next;
+            end = std::min<off64_t>(offset + chunks.chunkSize, chunks.size);
+            chunks.next = end;
+            res = true;
+        }
+
+        ::pthread_mutex_unlock(&chunks.mutex);
+        return res;
+    }
+
+    void chunkDone(Chunks &chunks, off64_t processed, int error)
+    {
+        chunks.statistics->addProcessed(processed);
+        ::pthread_mutex_lock(&chunks.mutex);
+
+        chunks.copied += processed;
+
+        if (error != 0 && chunks.error == 0)
+            chunks.error = error;
+
+        ::pthread_mutex_unlock(&chunks.mutex);
+    }
+
+    ssize_t copyPositional(Chunks &chunks, char *buffer, size_t size, off64_t offset)
+    {
+        ssize_t res = ::pread64(chunks.source, buffer, size, chunks.sourceOffset + offset);
+        ssize_t written;
+
+        for (ssize_t done = 0; done < res; done += written)
+            if ((written = ::pwrite64(chunks.destination, buffer + done, res - done, chunks.destinationOffset + offset + done)) < 0)
+                if (errno == EINTR)
+                    written = 0;
+                else
+                    return -1;
+
+        return res;
+    }
+
+    void *chunksWorker(void *arg)
+    {
+        Chunks &chunks = *static_cast<Chunks *>(arg);
+        char *buffer = NULL;
+        bool range = true;
+        off64_t offset;
+        off64_t end;
+        loff_t in;
+        loff_t out;
+        long long time;
+        ssize_t res;
+        int error;
+
+        while (fetchChunk(chunks, offset, end))
+            for (error = 0; offset < end && error == 0 && !chunks.statistics->aborted(); )
+            {
+                time = Tuner::now();
+
+                if (range)
+                {
+                    in = chunks.sourceOffset + offset;
+                    out = chunks.destinationOffset + offset;
+                    res = ::copy_file_range(chunks.source, &in, chunks.destination, &out,
+                                            std::min<off64_t>(end - offset, Engine::KernelChunkSize), 0);
+
+                    if (res < 0 && unsupported(errno))
+                    {
+                        range = false;
+                        continue;
+                    }
+                }
+                else
+                {
+                    if (buffer == NULL && (buffer = BufferPool::acquire(chunks.bufferSize)) == NULL)
+                    {
+                        chunkDone(chunks, 0, ENOMEM);
+                        break;
+                    }
+
+                    res = copyPositional(chunks, buffer, std::min<off64_t>(end - offset, chunks.bufferSize), offset);
+                }
+
+                if (res > 0)
+                {
+                    offset += res;
+                    chunks.statistics->tuner().sample(res, Tuner::now() - time);
+                }
+                else if (res < 0 && errno == EINTR)
+                    continue;
+                else
+                    /* Zero means the source has been truncated under us */
+                    error = res < 0 ? errno : EIO;
+
+                chunkDone(chunks, res > 0 ? res : 0, error);
+            }
+
+        if (buffer != NULL)
+            BufferPool::release(buffer, chunks.bufferSize);
+
+        ::pthread_mutex_lock(&chunks.mutex);
+
+        if (--chunks.running == 0)
+            ::pthread_cond_signal(&chunks.finished);
+
+        ::pthread_mutex_unlock(&chunks.mutex);
+        return NULL;
+    }
+
+}
+
+
+Engine::Engine(Statistics &statistics, const Options &options) :
+    m_statistics(statistics),
+    m_options(options),
+    m_method(None),
+    m_checksum(options.checksum),
+    m_copied(0),
+    m_skipped(false)
+{}
+
+Engine::~Engine()
+{}
+
+bool Engine::copy(const Interface::Holder &source, const Interface::Holder &destination)
+{
+    const IDescriptor *src = source->as<IDescriptor>();
+    const IDescriptor *dst = destination->as<IDescriptor>();
+    bool res = false;
+
+    m_method = None;
+    m_lastError = Error();
+    m_checksum.reset();
+    m_copied = 0;
+    m_skipped = false;
+
+    if (src != NULL && dst != NULL && !m_options.verify)
+    {
+        off64_t offset = ::lseek64(src->descriptor(), 0, SEEK_CUR);
+        res = kernelCopy(src->descriptor(), dst->descriptor());
+
+        /* Direct I/O wasn't possible, at least don't keep what was read */
+        if (m_options.direct && m_method != Direct && offset >= 0)
+            ::posix_fadvise64(src->descriptor(), offset, 0, POSIX_FADV_DONTNEED);
+    }
+
+    if (!res && m_method == None)
+        if (allowed(ReadWrite))
+            res = readWrite(source, destination);
+        else
+            m_lastError = Error(ENOTSUP);
+
+    m_statistics.report(true);
+    return res;
+}
+
+bool Engine::verify(const Interface::Holder &destination)
+{
+    IStream *stream = destination->as<IStream>();
+    BufferPool::Buffer buffer(m_options.bufferSize);
+    Checksum checksum(m_options.checksum);
+    off64_t length = 0;
+    size_t read;
+
+    ASSERT(m_options.verify);
+
+    if (UNLIKELY(buffer.data() == NULL))
+    {
+        m_lastError = Error(ENOMEM);
+        return false;
+    }
+
+    stream->advise(0, 0, IStream::NoReuse);
+
+    while (!aborted())
+    {
+        if ((read = stream->read(buffer.data(), m_options.bufferSize)) == 0)
+        {
+            if (!(m_lastError = stream->lastError()).isOk())
+                return false;
+
+            if (length != m_copied || checksum.value() != m_checksum.value())
+            {
+                m_lastError = Error(Error::ChecksumMismatch);
+                return false;
+            }
+
+            return true;
+        }
+
+        checksum.update(buffer.data(), read);
+        length += read;
+    }
+
+    m_lastError = Error(ECANCELED);
+    return false;
+}
+
+bool Engine::kernelCopy(int source, int destination)
+{
+    if (reflink(source, destination))
+        return true;
+    else if (m_method != None)
+        return false;
+
+    if (direct(source, destination))
+        return true;
+    else if (m_method != None)
+        return false;
+
+    if (sparse(source, destination))
+        return true;
+    else if (m_method != None || m_options.detectZeroes)
+        return false;
+
+    if (parallelChunks(source, destination))
+        return true;
+    else if (m_method != None)
+        return false;
+
+    if (copyFileRange(source, destination))
+        return true;
+    else if (m_method != None)
+        return false;
+
+    if (sendFile(source, destination))
+        return true;
+    else if (m_method != None)
+        return false;
+
+    return splice(source, destination);
+}
+
+/*
+ * Each kernel method below returns false with m_method left as None
+ * when it is not applicable, so that the next one can be tried. The
+ * end of the file is not trusted before anything is copied: pseudo
+ * files report no size and give nothing to copy_file_range() and
+ * friends, the read()/write() loop tells them from empty ones.
+ */
+
+bool Engine::reflink(int source, int destination)
+{
+#ifdef FICLONE
+    struct stat st;
+
+    if (!allowed(Reflink) ||
+        ::lseek64(source, 0, SEEK_CUR) != 0 || ::lseek64(destination, 0, SEEK_CUR) != 0 ||
+        ::fstat(destination, &st) != 0 || st.st_size != 0 ||
+        ::fstat(source, &st) != 0)
+    {
+        return false;
+    }
+
+    if (::ioctl(destination, FICLONE, source) != 0)
+    {
+        if (unsupported(errno))
+            return false;
+
+        m_method = Reflink;
+        m_lastError = Error(errno);
+        return false;
+    }
+
+    m_method = Reflink;
+    ::lseek64(source, st.st_size, SEEK_SET);
+    ::lseek64(destination, st.st_size, SEEK_SET);
+    progress(st.st_size);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Engine::direct(int source, int destination)
+{
+    struct stat st;
+    struct stat dst;
+    off64_t sourceOffset;
+    off64_t destinationOffset;
+    off64_t offset;
+    size_t size = (m_options.bufferSize + DirectAlignment - 1) & ~static_cast<size_t>(DirectAlignment - 1);
+    int sourceFlags;
+    int destinationFlags;
+    bool aligned = true;
+    char *buffer;
+    long long time;
+    ssize_t res;
+
+    if (!m_options.direct || !allowed(Direct) ||
+        ::fstat(source, &st) != 0 || !S_ISREG(st.st_mode) ||
+        ::fstat(destination, &dst) != 0 || !S_ISREG(dst.st_mode) ||
+        (sourceOffset = ::lseek64(source, 0, SEEK_CUR)) < 0 || (sourceOffset % DirectAlignment) != 0 ||
+        (destinationOffset = ::lseek64(destination, 0, SEEK_CUR)) < 0 || (destinationOffset % DirectAlignment) != 0 ||
+        /* The padded tail is cut by ftruncate(), there must be nothing after it */
+        dst.st_size > destinationOffset ||
+        (sourceFlags = ::fcntl(source, F_GETFL)) < 0 || (destinationFlags = ::fcntl(destination, F_GETFL)) < 0)
+    {
+        return false;
+    }
+
+    /* Pool buffers are aligned enough for O_DIRECT */
+    if ((buffer = BufferPool::acquire(size)) == NULL)
+        return false;
+
+    if (::fcntl(source, F_SETFL, sourceFlags | O_DIRECT) != 0 ||
+        ::fcntl(destination, F_SETFL, destinationFlags | O_DIRECT) != 0)
+    {
+        ::fcntl(source, F_SETFL, sourceFlags);
+        BufferPool::release(buffer, size);
+        return false;
+    }
+
+    for (offset = 0; ; offset += res)
+    {
+        if (aborted())
+        {
+            m_lastError = Error(ECANCELED);
+            break;
+        }
+
+        time = Tuner::now();
+
+        if ((res = ::pread64(source, buffer, size, sourceOffset + offset)) < 0)
+            if (errno == EINTR)
+            {
+                res = 0;
+                continue;
+            }
+            else
+            {
+                /* Some filesystems accept the flag and fail the first read */
+                if (m_method == None && unsupported(errno))
+                    break;
+
+                m_lastError = Error(errno);
+                break;
+            }
+        else if (res == 0)
+            break;
+
+        /* Short of the end of the file it breaks the alignment, the rest goes buffered */
+        if (aligned && static_cast<size_t>(res) < size && sourceOffset + offset + res < st.st_size)
+        {
+            ::fcntl(source, F_SETFL, sourceFlags);
+            ::fcntl(destination, F_SETFL, destinationFlags);
+            aligned = false;
+        }
+
+        /* The tail is padded to the alignment, ftruncate() cuts it */
+        if (!writePositional(destination, buffer,
+                             aligned ? (res + DirectAlignment - 1) & ~static_cast<ssize_t>(DirectAlignment - 1) : res,
+                             destinationOffset + offset))
+        {
+            if (m_method == None && unsupported(errno))
+                break;
+
+            m_method = Direct;
+            m_lastError = Error(errno);
+            break;
+        }
+
+        m_method = Direct;
+        m_statistics.tuner().sample(res, Tuner::now() - time);
+        progress(res);
+
+        /* That was the tail, nothing is read at an unaligned offset with O_DIRECT */
+        if (aligned && static_cast<size_t>(res) < size)
+        {
+            offset += res;
+            break;
+        }
+    }
+
+    ::fcntl(source, F_SETFL, sourceFlags);
+    ::fcntl(destination, F_SETFL, destinationFlags);
+    BufferPool::release(buffer, size);
+
+    if (m_method == None)
+        return false;
+    else if (!m_lastError.isOk())
+        return false;
+    else if (::ftruncate64(destination, destinationOffset + offset) != 0)
+    {
+        m_lastError = Error(errno);
+        return false;
+    }
+
+    ::lseek64(source, sourceOffset + offset, SEEK_SET);
+    ::lseek64(destination, destinationOffset + offset, SEEK_SET);
+    return true;
+}
+
+bool Engine::sparse(int source, int destination)
+{
+    struct stat st;
+    struct stat dst;
+    off64_t sourceOffset;
+    off64_t destinationOffset;
+    off64_t data;
+    off64_t hole;
+    bool range = !m_options.detectZeroes;
+    char *buffer = NULL;
+
+    if (!(m_options.sparse || m_options.detectZeroes) || !allowed(Sparse) ||
+        ::fstat(source, &st) != 0 || !S_ISREG(st.st_mode) ||
+        ::fstat(destination, &dst) != 0 || !S_ISREG(dst.st_mode) ||
+        (sourceOffset = ::lseek64(source, 0, SEEK_CUR)) < 0 ||
+        (destinationOffset = ::lseek64(destination, 0, SEEK_CUR)) < 0 ||
+        /* Holes are left as is, so there must be nothing to overwrite */
+        dst.st_size > destinationOffset)
+    {
+        return false;
+    }
+
+    if (!m_options.detectZeroes)
+    {
+        /* Fully allocated files are not worth the lseek() calls */
+        if (!m_options.sparse || st.st_blocks * 512 >= st.st_size)
+            return false;
+
+        hole = ::lseek64(source, sourceOffset, SEEK_HOLE);
+        ::lseek64(source, sourceOffset, SEEK_SET);
+
+        if (hole < 0 || hole >= st.st_size)
+            return false;
+    }
+
+    m_method = Sparse;
+
+    for (off64_t offset = sourceOffset; offset < st.st_size; offset = hole)
+    {
+        if (aborted())
+        {
+            m_lastError = Error(ECANCELED);
+            break;
+        }
+
+        if (!m_options.sparse)
+        {
+            data = offset;
+            hole = st.st_size;
+        }
+        else if ((data = ::lseek64(source, offset, SEEK_DATA)) < 0)
+            if (errno == ENXIO)
+                /* Hole till the end of the file */
+                data = hole = st.st_size;
+            else
+            {
+                m_lastError = Error(errno);
+                break;
+            }
+        else if ((hole = ::lseek64(source, data, SEEK_HOLE)) < 0)
+        {
+            m_lastError = Error(errno);
+            break;
+        }
+
+        progress(data - offset);
+
+        if (!copyExtent(source, destination, data, hole, destinationOffset - sourceOffset, range, buffer))
+            break;
+    }
+
+    if (buffer != NULL)
+        BufferPool::release(buffer, m_options.bufferSize);
+
+    if (!m_lastError.isOk())
+        return false;
+
+    if (::ftruncate64(destination, destinationOffset + st.st_size - sourceOffset) != 0)
+    {
+        m_lastError = Error(errno);
+        return false;
+    }
+
+    ::lseek64(source, st.st_size, SEEK_SET);
+    ::lseek64(destination, destinationOffset + st.st_size - sourceOffset, SEEK_SET);
+    return true;
+}
+
+bool Engine::copyExtent(int source, int destination, off64_t offset, off64_t end, off64_t delta, bool &range, char *&buffer)
+{
+    loff_t in;
+    loff_t out;
+    long long time;
+    ssize_t res;
+
+    while (offset < end)
+    {
+        if (aborted())
+        {
+            m_lastError = Error(ECANCELED);
+            return false;
+        }
+
+        time = Tuner::now();
+
+        if (range)
+        {
+            in = offset;
+            out = offset + delta;
+
+            if ((res = ::copy_file_range(source, &in, destination, &out, std::min<off64_t>(end - offset, KernelChunkSize), 0)) < 0 &&
+                unsupported(errno))
+            {
+                range = false;
+                continue;
+            }
+        }
+        else
+        {
+            if (buffer == NULL && UNLIKELY((buffer = BufferPool::acquire(m_options.bufferSize)) == NULL))
+            {
+                m_lastError = Error(ENOMEM);
+                return false;
+            }
+
+            if ((res = ::pread64(source, buffer, std::min<off64_t>(end - offset, m_options.bufferSize), offset)) > 0)
+                if (m_options.detectZeroes ?
+                        !writeSparse(destination, buffer, res, offset + delta) :
+                        !writePositional(destination, buffer, res, offset + delta))
+                {
+                    m_lastError = Error(errno);
+                    return false;
+                }
+        }
+
+        if (res > 0)
+        {
+            offset += res;
+            m_statistics.tuner().sample(res, Tuner::now() - time);
+            progress(res);
+        }
+        else if (res < 0 && errno == EINTR)
+            continue;
+        else
+        {
+            /* Zero means the source has been truncated under us */
+            m_lastError = Error(res < 0 ? errno : EIO);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Engine::parallelChunks(int source, int destination)
+{
+    struct stat st;
+    Chunks chunks;
+    pthread_t *threads;
+    struct timespec timeout;
+    int started = 0;
+
+    if (!allowed(ParallelChunks) || m_options.workers <= 1 || m_options.largeFileSize <= 0 || m_options.chunkSize == 0 ||
+        ::fstat(source, &st) != 0 || !S_ISREG(st.st_mode) ||
+        (chunks.sourceOffset = ::lseek64(source, 0, SEEK_CUR)) < 0 ||
+        (chunks.destinationOffset = ::lseek64(destination, 0, SEEK_CUR)) < 0 ||
+        (chunks.size = st.st_size - chunks.sourceOffset) < m_options.largeFileSize ||
+        Devices::limit(st.st_dev) <= 1 || Devices::limit(Devices::device(destination)) <= 1)
+    {
+        return false;
+    }
+
+    if (::fallocate64(destination, 0, chunks.destinationOffset, chunks.size) != 0 && !unsupported(errno))
+    {
+        m_method = ParallelChunks;
+        m_lastError = Error(errno);
+        return false;
+    }
+
+    if (UNLIKELY((threads = new (std::nothrow) pthread_t [m_options.workers]) == NULL))
+        return false;
+
+    ::pthread_mutex_init(&chunks.mutex, NULL);
+    ::pthread_cond_init(&chunks.finished, NULL);
+    chunks.statistics = &m_statistics;
+    chunks.source = source;
+    chunks.destination = destination;
+    chunks.next = 0;
+    chunks.copied = 0;
+    chunks.chunkSize = m_options.chunkSize;
+    chunks.bufferSize = m_options.bufferSize;
+    chunks.running = m_options.workers;
+    chunks.error = 0;
+
+    ::pthread_mutex_lock(&chunks.mutex);
+
+    for (; started < m_options.workers; ++started)
+        if (::pthread_create(&threads[started], NULL, chunksWorker, &chunks) != 0)
+        {
+            chunks.running = started;
+            break;
+        }
+
+    if (started > 0)
+    {
+        m_method = ParallelChunks;
+
+        /* Workers can't report, it is done from here */
+        while (chunks.running > 0)
+        {
+            ::clock_gettime(CLOCK_REALTIME, &timeout);
+            timeout.tv_nsec += 100 * 1000 * 1000;
+
+            if (timeout.tv_nsec >= 1000 * 1000 * 1000)
+            {
+                timeout.tv_nsec -= 1000 * 1000 * 1000;
+                ++timeout.tv_sec;
+            }
+
+            ::pthread_cond_timedwait(&chunks.finished, &chunks.mutex, &timeout);
+
+            ::pthread_mutex_unlock(&chunks.mutex);
+            m_statistics.report();
+            ::pthread_mutex_lock(&chunks.mutex);
+        }
+    }
+
+    ::pthread_mutex_unlock(&chunks.mutex);
+
+    for (int i = 0; i < started; ++i)
+        ::pthread_join(threads[i], NULL);
+
+    m_statistics.report();
+
+    delete [] threads;
+    ::pthread_cond_destroy(&chunks.finished);
+    ::pthread_mutex_destroy(&chunks.mutex);
+
+    if (started == 0)
+        return false;
+    else if (chunks.error != 0)
+        m_lastError = Error(chunks.error);
+    else if (chunks.copied < chunks.size)
+        m_lastError = Error(ECANCELED);
+    else
+    {
+        ::lseek64(source, chunks.sourceOffset + chunks.size, SEEK_SET);
+        ::lseek64(destination, chunks.destinationOffset + chunks.size, SEEK_SET);
+        return true;
+    }
+
+    return false;
+}
+
+bool Engine::copyFileRange(int source, int destination)
+{
+    Tuner &tuner = m_statistics.tuner();
+    long long time;
+    ssize_t res;
+
+    if (!allowed(CopyFileRange))
+        return false;
+
+    while (!aborted())
+    {
+        time = Tuner::now();
+        res = ::copy_file_range(source, NULL, destination, NULL, tuner.chunkSize(), 0);
+
+        if (res > 0)
+        {
+            m_method = CopyFileRange;
+            tuner.sample(res, Tuner::now() - time);
+            progress(res);
+        }
+        /* Nothing at all may be an empty file or one which can't be copied so (procfs) */
+        else if (res == 0)
+            return m_method != None;
+        else if (errno == EINTR)
+            continue;
+        else
+        {
+            if (m_method == None && unsupported(errno))
+                return false;
+
+            m_method = CopyFileRange;
+            m_lastError = Error(errno);
+            return false;
+        }
+    }
+
+    m_method = CopyFileRange;
+    m_lastError = Error(ECANCELED);
+    return false;
+}
+
+bool Engine::sendFile(int source, int destination)
+{
+    Tuner &tuner = m_statistics.tuner();
+    long long time;
+    ssize_t res;
+
+    if (!allowed(SendFile))
+        return false;
+
+    while (!aborted())
+    {
+        time = Tuner::now();
+        res = ::sendfile64(destination, source, NULL, tuner.chunkSize());
+
+        if (res > 0)
+        {
+            m_method = SendFile;
+            tuner.sample(res, Tuner::now() - time);
+            progress(res);
+        }
+        /* Nothing at all may be an empty file or one which can't be copied so (procfs) */
+        else if (res == 0)
+            return m_method != None;
+        else if (errno == EINTR)
+            continue;
+        else
+        {
+            if (m_method == None && unsupported(errno))
+                return false;
+
+            m_method = SendFile;
+            m_lastError = Error(errno);
+            return false;
+        }
+    }
+
+    m_method = SendFile;
+    m_lastError = Error(ECANCELED);
+    return false;
+}
+
+bool Engine::splice(int source, int destination)
+{
+    int pipe[2];
+    long long time;
+    ssize_t res;
+    ssize_t left;
+    ssize_t len;
+    bool ok = false;
+    bool drained = false;
+
+    if (!allowed(Splice) || ::pipe2(pipe, O_CLOEXEC) != 0)
+        return false;
+
+    while (!aborted())
+    {
+        time = Tuner::now();
+        res = ::splice(source, NULL, pipe[1], NULL, KernelChunkSize, SPLICE_F_MOVE | SPLICE_F_MORE);
+
+        if (res == 0)
+        {
+            ok = m_method != None;
+            break;
+        }
+        else if (res < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            if (m_method != None || !unsupported(errno))
+            {
+                m_method = Splice;
+                m_lastError = Error(errno);
+            }
+
+            break;
+        }
+
+        for (left = res; left > 0; left -= len)
+            if ((len = ::splice(pipe[0], NULL, destination, NULL, left, SPLICE_F_MOVE | SPLICE_F_MORE)) <= 0)
+                if (len < 0 && errno == EINTR)
+                    len = 0;
+                else
+                {
+                    /* The destination doesn't take splice() (O_APPEND), the rest goes by read()/write() */
+                    if (len < 0 && unsupported(errno) && drain(pipe[0], destination, left))
+                        drained = true;
+                    else
+                    {
+                        m_method = Splice;
+                        m_lastError = Error(len < 0 ? errno : EIO);
+                    }
+
+                    break;
+                }
+
+        if (left > 0 && !drained)
+            break;
+
+        m_statistics.tuner().sample(res, Tuner::now() - time);
+        progress(res);
+
+        if (drained)
+        {
+            m_method = None;
+            break;
+        }
+
+        m_method = Splice;
+    }
+
+    if (m_method == Splice && !ok && m_lastError.isOk())
+        m_lastError = Error(ECANCELED);
+
+    ::close(pipe[0]);
+    ::close(pipe[1]);
+
+    return ok;
+}
+
+bool Engine::readWrite(const Interface::Holder &source, const Interface::Holder &destination)
+{
+    IStream *src = source->as<IStream>();
+    IStream *dst = destination->as<IStream>();
+    Tuner &tuner = m_statistics.tuner();
+    long long time;
+    size_t read;
+
+    m_method = ReadWrite;
+
+    while (!aborted())
+    {
+        /* Chunk size may be changed by the tuner while the file is copied */
+        BufferPool::Buffer buffer(tuner.chunkSize());
+
+        if (UNLIKELY(buffer.data() == NULL))
+        {
+            m_lastError = Error(ENOMEM);
+            return false;
+        }
+
+        while (buffer.size() == tuner.chunkSize() && !aborted())
+        {
+            time = Tuner::now();
+
+            if ((read = src->read(buffer.data(), buffer.size())) == 0)
+            {
+                m_lastError = src->lastError();
+
+                /* Trailing hole, the size is set by writing its last byte */
+                if (m_lastError.isOk() && m_skipped)
+                    if (!dst->seek(-1, IStream::FromCurrent) || dst->write("", 1) != 1)
+                        m_lastError = dst->lastError();
+
+                return m_lastError.isOk();
+            }
+
+            if (m_options.detectZeroes ?
+                    !writeSkippingZeroes(dst, buffer.data(), read) :
+                    dst->write(buffer.data(), read) != read)
+            {
+                m_lastError = dst->lastError();
+                return false;
+            }
+
+            tuner.sample(read, Tuner::now() - time);
+
+            if (m_options.verify)
+                m_checksum.update(buffer.data(), read);
+
+            m_copied += read;
+            progress(read);
+        }
+    }
+
+    m_lastError = Error(ECANCELED);
+    return false;
+}
+
+bool Engine::writeSkippingZeroes(IStream *destination, const char *buffer, size_t size)
+{
+    bool zero;
+
+    for (size_t run; size > 0; buffer += run, size -= run)
+    {
+        run = zeroRun(buffer, size, zero);
+
+        /* Streams which can't seek get the zeroes written */
+        if (zero && destination->seek(run, IStream::FromCurrent))
+            m_skipped = true;
+        else if (destination->write(buffer, run) != run)
+            return false;
+        else
+            m_skipped = false;
+    }
+
+    return true;
+}
+
+}}
@@ -0,0 +1,179 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_COPY_ENGINE_H_
+#define LVFS_COPY_ENGINE_H_
+
+#include <platform/utils.h>
+#include <lvfs/Interface>
+#include <lvfs/Error>
+#include <lvfs/IStream>
+#include <lvfs/Checksum>
+#include <lvfs/copy/Statistics>
+
+
+namespace LVFS {
+namespace Copy {
+
+/**
+ * Copies the rest of one IStream into another.
+ *
+ * If both streams implement IDescriptor the data does not leave the
+ * kernel: reflink (FICLONE) is tried first, then copy_file_range(),
+ * sendfile() and splice(). The read()/write() loop is the last resort.
+ *
+ * Sparse regular files (Options::sparse) are copied extent by extent
+ * found with SEEK_DATA/SEEK_HOLE, holes are left unwritten and the
+ * destination is extended with ftruncate(). Options::detectZeroes
+ * additionally turns blocks of ZeroBlockSize zeroes into holes, even
+ * if the source is not sparse; kernel methods other than reflink can't
+ * see the data, so the copy goes through a buffer then.
+ *
+ * Options::direct moves the data between regular files with O_DIRECT
+ * set on both descriptors, through a DirectAlignment aligned buffer, so
+ * that a bulk copy doesn't evict the page cache. The unaligned tail is
+ * written padded and cut with ftruncate(). A short read before the end
+ * of the file drops O_DIRECT, the rest is copied buffered. If a
+ * filesystem refuses O_DIRECT, the other methods are used and the
+ * source range is dropped from the cache afterwards (POSIX_FADV_DONTNEED).
+ *
+ * Files larger than Options::largeFileSize are preallocated and split
+ * into Options::chunkSize pieces copied by Options::workers threads
+ * with positional I/O, unless one of the devices allows only one
+ * transfer at a time (see Copy::Devices).
+ *
+ * Options::methods limits the methods which may be used, a method left
+ * out is skipped as if it were not applicable. If none of the allowed
+ * ones can copy the file, copy() fails with ENOTSUP.
+ *
+ * With Options::verify the data always goes through the read()/write()
+ * loop, so that its checksum is computed on the way. verify() then
+ * reads the destination back and fails with Error::ChecksumMismatch
+ * if it differs.
+ *
+ * Copied bytes are added to the given Statistics, which also tells
+ * whether the copy has been aborted. Every transfer is sampled by its
+ * Tuner, the read()/write() loop, copy_file_range() and sendfile() move
+ * Tuner::chunkSize() bytes at a time.
+ */
+class PLATFORM_MAKE_PUBLIC Engine
+{
+    PLATFORM_MAKE_NONCOPYABLE(Engine)
+    PLATFORM_MAKE_NONMOVEABLE(Engine)
+
+public:
+    enum Method
+    {
+        None,
+        Reflink,
+        CopyFileRange,
+        SendFile,
+        Splice,
+        ReadWrite,
+        ParallelChunks,
+        Sparse,
+        Direct
+    };
+
+    enum
+    {
+        DefaultBufferSize = 1024 * 1024,
+        KernelChunkSize = 8 * 1024 * 1024,
+        DefaultChunkSize = 64 * 1024 * 1024,
+        DefaultWorkers = 4,
+        ZeroBlockSize = 4096,
+        DirectAlignment = 4096,
+        AllMethods = (1 << (Direct + 1)) - 1
+    };
+
+    static const off64_t DefaultLargeFileSize = 1024 * 1024 * 1024;
+
+    struct Options
+    {
+        Options() :
+            bufferSize(DefaultBufferSize),
+            chunkSize(DefaultChunkSize),
+            workers(DefaultWorkers),
+            largeFileSize(DefaultLargeFileSize),
+            verify(false),
+            sparse(true),
+            detectZeroes(false),
+            direct(false),
+            methods(AllMethods),
+            checksum(Checksum::Crc32c)
+        {}
+
+        /** Buffer of sparse, direct and chunked copies and verification. */
+        size_t bufferSize;
+        size_t chunkSize;
+        int workers;
+        /** Files of at least this size are copied in parallel chunks, 0 disables it. */
+        off64_t largeFileSize;
+        bool verify;
+        /** Skip holes of sparse sources. */
+        bool sparse;
+        /** Don't write blocks of zeroes, leave holes instead. */
+        bool detectZeroes;
+        /** Bypass the page cache. */
+        bool direct;
+        /** Methods which may be used, a mask of (1 << Method). */
+        unsigned methods;
+        Checksum::Algorithm checksum;
+    };
+
+public:
+    Engine(Statistics &statistics, const Options &options = Options());
+    ~Engine();
+
+    bool copy(const Interface::Holder &source, const Interface::Holder &destination);
+    bool verify(const Interface::Holder &destination);
+
+    inline Method method() const { return m_method; }
+    inline const Error &lastError() const { return m_lastError; }
+
+private:
+    bool kernelCopy(int source, int destination);
+    bool reflink(int source, int destination);
+    bool direct(int source, int destination);
+    bool sparse(int source, int destination);
+    bool copyExtent(int source, int destination, off64_t offset, off64_t end, off64_t delta, bool &range, char *&buffer);
+    bool parallelChunks(int source, int destination);
+    bool copyFileRange(int source, int destination);
+    bool sendFile(int source, int destination);
+    bool splice(int source, int destination);
+    bool readWrite(const Interface::Holder &source, const Interface::Holder &destination);
+    bool writeSkippingZeroes(IStream *destination, const char *buffer, size_t size);
+
+    inline bool allowed(Method method) const { return (m_options.methods & (1u << method)) != 0; }
+    inline bool aborted() const { return m_statistics.aborted(); }
+    inline void progress(off64_t processed) { m_statistics.addProcessed(processed); m_statistics.report(); }
+
+private:
+    Statistics &m_statistics;
+    Options m_options;
+    Method m_method;
+    Checksum m_checksum;
+    off64_t m_copied;
+    bool m_skipped;
+    Error m_lastError;
+};
+
+}}
+
+#endif /* LVFS_COPY_ENGINE_H_ */
@@ -0,0 +1,732 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_copy_Job.h"
+#include "lvfs_copy_Devices.h"
+
+#include <lvfs/IEntry>
+#include <lvfs/IDescriptor>
+#include <lvfs/IIdentity>
+#include <lvfs/IProperties>
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+namespace LVFS {
+namespace Copy {
+
+namespace {
+
+    inline void addMilliseconds(struct timespec &time, long ms)
+    {
+        time.tv_sec += ms / 1000;
+        time.tv_nsec += (ms % 1000) * 1000 * 1000;
+
+        if (time.tv_nsec >= 1000 * 1000 * 1000)
+        {
+            time.tv_nsec -= 1000 * 1000 * 1000;
+            ++time.tv_sec;
+        }
+    }
+
+    /* Moves a local entry into a local directory on the same filesystem */
+    bool renameLocal(const Interface::Holder &entry, const Interface::Holder &directory, unsigned int flags)
+    {
+        const IEntry *source = entry->as<IEntry>();
+        const IEntry *target = directory->as<IEntry>();
+        char path[PATH_MAX];
+        struct stat src;
+        struct stat dst;
+
+        if (source == NULL || target == NULL ||
+            std::strcmp(source->schema(), "file") != 0 || std::strcmp(target->schema(), "file") != 0 ||
+            ::lstat(source->location(), &src) != 0 || ::stat(target->location(), &dst) != 0 ||
+            src.st_dev != dst.st_dev ||
+            std::snprintf(path, sizeof(path), "%s/%s", target->location(), source->title()) >= static_cast<int>(sizeof(path)))
+        {
+            return false;
+        }
+
+        /* Any failure leaves it to the copy, which reports the real errors */
+        return ::renameat2(AT_FDCWD, source->location(), AT_FDCWD, path, flags) == 0;
+    }
+
+    inline bool isLocal(const Interface::Holder &entry)
+    {
+        const IEntry *e = entry->as<IEntry>();
+        return e != NULL && std::strcmp(e->schema(), "file") == 0;
+    }
+
+    bool identify(const Interface::Holder &entry, IIdentity::Key &key, nlink_t &links)
+    {
+        struct stat st;
+
+        if (const IIdentity *identity = entry->as<IIdentity>())
+        {
+            key = identity->key();
+            links = identity->links();
+            return true;
+        }
+        else if (isLocal(entry) && ::lstat(entry->as<IEntry>()->location(), &st) == 0 && S_ISREG(st.st_mode))
+        {
+            key.device = st.st_dev;
+            key.inode = st.st_ino;
+            key.generation = 0;
+            links = st.st_nlink;
+            return true;
+        }
+
+        return false;
+    }
+
+    /* Makes another link of the local file "existing" in a local directory */
+    bool hardlink(const Interface::Holder &existing, const Interface::Holder &directory, const IEntry *entry)
+    {
+        char path[PATH_MAX];
+
+        if (std::snprintf(path, sizeof(path), "%s/%s", directory->as<IEntry>()->location(), entry->title()) >= static_cast<int>(sizeof(path)))
+            return false;
+
+        /* An existing file is left to the copy, which treats it as any other one */
+        return ::linkat(AT_FDCWD, existing->as<IEntry>()->location(), AT_FDCWD, path, 0) == 0;
+    }
+
+    /* IEntry::open() has no error of its own, the directory of the entry may know it */
+    inline Error openError(const IDirectory *directory)
+    {
+        return directory->lastError().isOk() ? Error(EIO) : directory->lastError();
+    }
+
+}
+
+
+Job::Job(const Progress &progress,
+         const Interface::Holder &source, const Files &files,
+         const Interface::Holder &destination,
+         const Options &options) :
+    m_statistics(progress),
+    m_source(source),
+    m_destination(destination),
+    m_options(options),
+    m_failed(0),
+    m_files(files),
+    m_scanning(0),
+    m_running(0),
+    m_active(0)
+{
+    ::pthread_mutex_init(&m_mutex, NULL);
+    ::pthread_cond_init(&m_changed, NULL);
+    m_statistics.tuner().setMaxInFlight(m_options.workers);
+}
+
+Job::~Job()
+{
+    for (auto &i : m_filesystems)
+        ::close(i.second);
+
+    ::pthread_cond_destroy(&m_changed);
+    ::pthread_mutex_destroy(&m_mutex);
+}
+
+bool Job::run()
+{
+    m_statistics.start();
+
+    for (auto i : m_files)
+        /* Whole trees, if the destination doesn't have them already */
+        if (m_options.move && renameLocal(i, m_destination, RENAME_NOREPLACE))
+        {
+            m_statistics.addTotal(0);
+            m_statistics.addProcessedFile();
+        }
+        else
+            add(i, m_source, NULL);
+
+    spawn(worker);
+
+    if (m_options.durability != None && !m_statistics.aborted())
+        syncDestination();
+
+    if (m_options.move && !m_statistics.aborted())
+        removeSources();
+
+    m_statistics.report(true);
+
+    if (m_lastError.isOk() && m_statistics.aborted())
+        m_lastError = Error(ECANCELED);
+
+    return m_lastError.isOk();
+}
+
+void Job::spawn(void *(*worker)(void *))
+{
+    pthread_t *threads = new (std::nothrow) pthread_t [m_options.workers];
+    struct timespec timeout;
+    int started = 0;
+
+    if (LIKELY(threads != NULL))
+    {
+        Locker lock(m_mutex);
+
+        for (; started < m_options.workers; ++started)
+            if (::pthread_create(&threads[started], NULL, worker, this) != 0)
+                break;
+
+        m_running = started;
+
+        /* Workers can't report, it is done from here */
+        while (m_running > 0)
+        {
+            ::clock_gettime(CLOCK_REALTIME, &timeout);
+            addMilliseconds(timeout, Statistics::DefaultInterval);
+            ::pthread_cond_timedwait(&m_changed, &m_mutex, &timeout);
+
+            ::pthread_mutex_unlock(&m_mutex);
+            removeCopied();
+            m_statistics.report();
+            ::pthread_mutex_lock(&m_mutex);
+        }
+    }
+
+    for (int i = 0; i < started; ++i)
+        ::pthread_join(threads[i], NULL);
+
+    delete [] threads;
+
+    if (started == 0)
+    {
+        m_running = 1;
+        worker(this);
+    }
+
+    removeCopied();
+    m_statistics.report();
+}
+
+void Job::finished()
+{
+    Locker lock(m_mutex);
+
+    if (--m_running == 0)
+        ::pthread_cond_broadcast(&m_changed);
+}
+
+void *Job::worker(void *job)
+{
+    Job *self = static_cast<Job *>(job);
+    Task *task;
+
+    for (;;)
+    {
+        {
+            Locker lock(self->m_mutex);
+
+            /*
+             * Directories feed the others, so one of them is always scanned
+             * while there are any, files are taken while there are slots
+             * for them. One of the busy ones wakes us up when done.
+             */
+            task = NULL;
+
+            while (!self->m_statistics.aborted())
+            {
+                if (!self->m_pending.empty() &&
+                    (self->m_scanning == 0 || self->m_ready.empty() || self->m_active >= self->m_statistics.tuner().inFlight()))
+                {
+                    task = self->m_pending.front();
+                    self->m_pending.pop_front();
+                    ++self->m_scanning;
+                    break;
+                }
+                else if (!self->m_ready.empty() && self->m_active < self->m_statistics.tuner().inFlight())
+                {
+                    task = self->m_ready.front();
+                    self->m_ready.pop_front();
+                    ++self->m_active;
+                    break;
+                }
+                else if (self->m_pending.empty() && self->m_ready.empty() && self->m_scanning == 0)
+                    break;
+
+                ::pthread_cond_wait(&self->m_changed, &self->m_mutex);
+            }
+
+            if (task == NULL)
+                break;
+        }
+
+        if (task->isDirectory)
+            self->scan(task);
+        else
+            self->copy(task);
+
+        Locker lock(self->m_mutex);
+
+        if (task->isDirectory)
+            --self->m_scanning;
+        else
+            --self->m_active;
+
+        ::pthread_cond_broadcast(&self->m_changed);
+    }
+
+    self->finished();
+    return NULL;
+}
+
+void *Job::syncWorker(void *job)
+{
+    Job *self = static_cast<Job *>(job);
+    Sync sync;
+    const IDescriptor *descriptor;
+    const IEntry *entry;
+    int fd;
+
+    for (;;)
+    {
+        {
+            Locker lock(self->m_mutex);
+
+            if (self->m_syncs.empty() || self->m_statistics.aborted())
+                break;
+
+            sync = self->m_syncs.front();
+            self->m_syncs.pop_front();
+        }
+
+        if (sync.filesystem >= 0)
+        {
+            if (::syncfs(sync.filesystem) != 0)
+                self->fail(NULL, Error(errno));
+
+            ::close(sync.filesystem);
+        }
+        else if ((descriptor = sync.directory->as<IDescriptor>()) != NULL)
+        {
+            if (::fsync(descriptor->descriptor()) != 0)
+                self->fail(NULL, Error(errno));
+        }
+        else if ((entry = sync.directory->as<IEntry>()) != NULL && std::strcmp(entry->schema(), "file") == 0)
+            if ((fd = ::open(entry->location(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 || ::fsync(fd) != 0)
+            {
+                self->fail(NULL, Error(errno));
+
+                if (fd >= 0)
+                    ::close(fd);
+            }
+            else
+                ::close(fd);
+    }
+
+    {
+        /* Whatever is left after a failure */
+        Locker lock(self->m_mutex);
+
+        for (; !self->m_syncs.empty(); self->m_syncs.pop_front())
+            if (self->m_syncs.front().filesystem >= 0)
+                ::close(self->m_syncs.front().filesystem);
+    }
+
+    self->finished();
+    return NULL;
+}
+
+void Job::add(const Interface::Holder &entry, const Interface::Holder &directory, Task *parent)
+{
+    Task task = { entry, directory, Interface::Holder(), parent, 0, entry->as<IDirectory>() != NULL, false, false };
+
+    if (!task.isDirectory)
+        if (const IProperties *props = entry->as<IProperties>())
+            task.size = props->size();
+
+    if (!task.isDirectory)
+        m_statistics.addTotal(task.size);
+
+    Locker lock(m_mutex);
+    m_tasks.push_back(task);
+
+    if (task.isDirectory)
+        m_pending.push_back(&m_tasks.back());
+    else
+        m_ready.push_back(&m_tasks.back());
+
+    ::pthread_cond_broadcast(&m_changed);
+}
+
+void Job::scan(Task *task)
+{
+    const IDirectory *dir = task->entry->as<IDirectory>();
+
+    /* Nothing goes into a directory which failed */
+    if (!makeDirectory(task))
+        return;
+
+    for (auto i = dir->begin(), end = dir->end(); i != end && !m_statistics.aborted(); ++i)
+        add(*i, task->entry, task);
+}
+
+bool Job::makeDirectory(Task *task)
+{
+    IDirectory *parent = (task->parent ? task->parent->destination : m_destination)->as<IDirectory>();
+    const IEntry *entry = task->entry->as<IEntry>();
+    Interface::Holder destination;
+    Error error;
+
+    {
+        /* Parents are made before their children are even listed */
+        Locker lock(m_mutex);
+
+        if (!(destination = parent->entry(entry->title(), entry->type(), true)).isValid())
+            error = parent->lastError();
+        else if (destination->as<IDirectory>() == NULL)
+        {
+            destination.reset();
+            error = Error(ENOTDIR);
+        }
+        else
+            task->destination = destination;
+    }
+
+    if (!destination.isValid())
+    {
+        fail(task, error);
+        return false;
+    }
+
+    return true;
+}
+
+bool Job::copy(Task *task)
+{
+    const Interface::Holder &directory = task->parent ? task->parent->destination : m_destination;
+    Interface::Holder destination;
+    IIdentity::Key identity;
+    nlink_t links;
+    bool tracked = false;
+    bool copied;
+
+    if (m_options.move && renameLocal(task->entry, directory, 0))
+    {
+        task->renamed = true;
+        m_statistics.addProcessed(task->size);
+        m_statistics.addProcessedFile();
+        return true;
+    }
+
+    /* Moves remove sources on the way, so links may look single already */
+    if (m_options.hardlinks && isLocal(directory) &&
+        identify(task->entry, identity, links) && (links > 1 || m_options.move))
+    {
+        Locker lock(m_mutex);
+        auto i = m_links.find(identity);
+
+        /* Other links wait for the first one to be copied */
+        while (i != m_links.end() && !(*i).second.copied && !m_statistics.aborted())
+        {
+            ::pthread_cond_wait(&m_changed, &m_mutex);
+            i = m_links.find(identity);
+        }
+
+        if (i == m_links.end())
+        {
+            if (links > 1 && m_links.size() < MaxLinks)
+            {
+                Link link = { Interface::Holder(), links - 1, false };
+                m_links[identity] = link;
+                tracked = true;
+            }
+        }
+        else if ((*i).second.copied)
+        {
+            destination = (*i).second.destination;
+
+            if (--(*i).second.left == 0)
+                m_links.erase(i);
+        }
+    }
+
+    if (destination.isValid())
+        if (hardlink(destination, directory, task->entry->as<IEntry>()))
+        {
+            m_statistics.addAvoided(task->size);
+            return done(task);
+        }
+        else
+            destination.reset();
+
+    copied = transfer(task, destination);
+
+    if (tracked)
+    {
+        Locker lock(m_mutex);
+        auto i = m_links.find(identity);
+
+        if (copied && isLocal(destination))
+        {
+            (*i).second.destination = destination;
+            (*i).second.copied = true;
+        }
+        else
+            m_links.erase(i);
+
+        ::pthread_cond_broadcast(&m_changed);
+    }
+
+    return copied && done(task);
+}
+
+bool Job::transfer(Task *task, Interface::Holder &destination)
+{
+    IDirectory *parent = (task->parent ? task->parent->destination : m_destination)->as<IDirectory>();
+    const IEntry *entry = task->entry->as<IEntry>();
+    Engine engine(m_statistics, m_options.engine);
+    Interface::Holder source;
+    Interface::Holder target;
+
+    Error error;
+
+    {
+        Locker lock(m_mutex);
+
+        if (!(destination = parent->entry(entry->title(), entry->type(), true)).isValid())
+            error = parent->lastError();
+    }
+
+    if (!destination.isValid())
+    {
+        fail(task, error);
+        return false;
+    }
+
+    if (!(source = entry->open(IStream::Read)).isValid())
+    {
+        {
+            Locker lock(m_mutex);
+            error = openError(task->directory->as<IDirectory>());
+        }
+
+        fail(task, error);
+        return false;
+    }
+
+    if (!(target = destination->as<IEntry>()->open(IStream::Write)).isValid())
+    {
+        {
+            Locker lock(m_mutex);
+            error = openError(parent);
+        }
+
+        fail(task, error);
+        return false;
+    }
+
+    {
+        const IDescriptor *in = source->as<IDescriptor>();
+        const IDescriptor *out = target->as<IDescriptor>();
+        Devices::Slot slot(in ? Devices::device(in->descriptor()) : 0, out ? Devices::device(out->descriptor()) : 0);
+
+        if (!engine.copy(source, target))
+        {
+            fail(task, engine.lastError());
+            return false;
+        }
+    }
+
+    source.reset();
+
+    if (!target->as<IStream>()->flush())
+    {
+        fail(task, target->as<IStream>()->lastError());
+        return false;
+    }
+
+    if (m_options.durability != None && !sync(task, target))
+        return false;
+
+    target.reset();
+
+    if (m_options.engine.verify)
+        if (!(target = destination->as<IEntry>()->open(IStream::Read)).isValid())
+        {
+            {
+                Locker lock(m_mutex);
+                error = openError(parent);
+            }
+
+            fail(task, error);
+            return false;
+        }
+        else if (!engine.verify(target))
+        {
+            fail(task, engine.lastError());
+            return false;
+        }
+        else
+            target.reset();
+
+    return true;
+}
+
+bool Job::done(Task *task)
+{
+    /* Batched moves remove sources once the destination is synced */
+    if (m_options.move && m_options.durability != Batched)
+    {
+        Locker lock(m_mutex);
+        m_removals.push_back(task);
+        ::pthread_cond_broadcast(&m_changed);
+    }
+    else
+        m_statistics.addProcessedFile();
+
+    return true;
+}
+
+bool Job::sync(Task *task, const Interface::Holder &target)
+{
+    const IDescriptor *descriptor = target->as<IDescriptor>();
+    struct stat st;
+    int fd;
+
+    /* Streams without descriptors have only flush() */
+    if (descriptor == NULL)
+        return true;
+
+    if (m_options.durability == PerFile)
+    {
+        if (::fdatasync(descriptor->descriptor()) == 0)
+            return true;
+    }
+    else if (::fstat(descriptor->descriptor(), &st) == 0)
+    {
+        /* Just a hint, the data is synced with the filesystem */
+        ::sync_file_range(descriptor->descriptor(), 0, 0, SYNC_FILE_RANGE_WRITE);
+
+        Locker lock(m_mutex);
+
+        if (m_filesystems.find(st.st_dev) != m_filesystems.end())
+            return true;
+
+        if ((fd = ::dup(descriptor->descriptor())) >= 0)
+        {
+            m_filesystems[st.st_dev] = fd;
+            return true;
+        }
+    }
+
+    fail(task, Error(errno));
+    return false;
+}
+
+void Job::syncDestination()
+{
+    Sync sync = { Interface::Holder(), -1 };
+
+    for (auto &i : m_filesystems)
+    {
+        sync.filesystem = i.second;
+        m_syncs.push_back(sync);
+    }
+
+    m_filesystems.clear();
+    sync.filesystem = -1;
+
+    sync.directory = m_destination;
+    m_syncs.push_back(sync);
+
+    for (auto &i : m_tasks)
+        if (i.isDirectory && i.destination.isValid())
+        {
+            sync.directory = i.destination;
+            m_syncs.push_back(sync);
+        }
+
+    spawn(syncWorker);
+}
+
+void Job::removeCopied()
+{
+    IDirectory *directory;
+    Task *task;
+    Error error;
+
+    for (;;)
+    {
+        {
+            Locker lock(m_mutex);
+
+            if (m_removals.empty())
+                break;
+
+            task = m_removals.front();
+            m_removals.pop_front();
+            directory = task->directory->as<IDirectory>();
+
+            if (directory->remove(task->entry))
+            {
+                m_statistics.addProcessedFile();
+                continue;
+            }
+
+            error = directory->lastError();
+        }
+
+        fail(task, error);
+    }
+}
+
+void Job::removeSources()
+{
+    IDirectory *directory;
+
+    /* Children always follow their parents, so go backwards */
+    for (auto i = m_tasks.rbegin(), end = m_tasks.rend(); i != end; ++i)
+        if (((*i).isDirectory || m_options.durability == Batched) && !(*i).failed && !(*i).renamed)
+        {
+            directory = (*i).directory->as<IDirectory>();
+
+            if (!directory->remove((*i).entry))
+                fail(&(*i), directory->lastError());
+        }
+}
+
+void Job::fail(Task *task, const Error &error)
+{
+    ++m_failed;
+
+    Locker lock(m_mutex);
+
+    /* Keeps the sources of the parents of moves */
+    for (; task != NULL; task = task->parent)
+        task->failed = true;
+
+    if (m_lastError.isOk())
+        m_lastError = error;
+
+    ::pthread_cond_broadcast(&m_changed);
+}
+
+}}
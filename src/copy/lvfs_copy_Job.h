@@ -0,0 +1,228 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_COPY_JOB_H_
+#define LVFS_COPY_JOB_H_
+
+#include <sys/types.h>
+#include <atomic>
+#include <pthread.h>
+#include <efc/List>
+#include <efc/Map>
+#include <lvfs/IIdentity>
+#include <lvfs/copy/Engine>
+
+
+namespace LVFS {
+namespace Copy {
+
+/**
+ * Copies (or moves) a set of entries of one IDirectory into another.
+ *
+ * run() scans and copies with the same Options::workers threads: a
+ * directory is created in the destination and listed by one of them
+ * while the others copy the files found so far, so the copy doesn't
+ * wait for the whole scan, and opening, creating, copying and closing
+ * of different files overlap. The totals grow as the scan goes on, at
+ * least one thread keeps scanning while there are directories left.
+ * Directory modifications are
+ * serialized by the job, streams are processed concurrently, within
+ * the per device limits of Copy::Devices.
+ *
+ * Options::durability decides what happens to the written data:
+ *  - None: streams are flushed, nothing else;
+ *  - PerFile: each file is fdatasync()ed before it counts as copied;
+ *  - Batched: only writeback of each file is started, every destination
+ *    filesystem gets one syncfs() at the end, in parallel.
+ * Both of the latter fsync() the destination directories at the end,
+ * those implementing IDescriptor or local ("file" schema) ones.
+ * With Batched moves sources are removed after the sync.
+ *
+ * Moves between local directories of one filesystem are a rename() per
+ * source entry, directories included, unless the destination exists;
+ * files of merged directories are renamed one by one. Other moves copy
+ * files and hand each one, once copied (flushed, synced or verified as
+ * the options say), to the thread of run(), which removes the source
+ * while the workers go on with the next files.
+ *
+ * With Options::hardlinks files having more than one link (as told by
+ * IIdentity or, for local entries, by lstat()) are copied once, their
+ * other links in the sources become links of the copy, provided it is
+ * local and the name is free in the destination, otherwise they are
+ * copied as well. The bytes not copied so count as processed and are
+ * reported by Statistics::avoidedBytes(). At most MaxLinks files are
+ * tracked at a time, each one until all its links are seen, the rest
+ * are copied.
+ *
+ * Of Options::workers threads only Tuner::inFlight() of the job's
+ * statistics() transfer at a time.
+ *
+ * Errors don't stop the job: the entry and its parents are marked
+ * failed, so moves keep their sources, the contents of a directory
+ * which could not be created are skipped, failures are counted and the
+ * first error is kept. Only cancel() and Progress::aborted stop it.
+ *
+ * Progress::function() is called from the thread of run() with the
+ * number of bytes copied since the previous call, see Statistics.
+ * statistics() and cancel() may be used from any thread while the
+ * job runs.
+ */
+class PLATFORM_MAKE_PUBLIC Job
+{
+    PLATFORM_MAKE_NONCOPYABLE(Job)
+    PLATFORM_MAKE_NONMOVEABLE(Job)
+
+public:
+    typedef Statistics::Progress Progress;
+    typedef ::EFC::List<Interface::Holder> Files;
+
+    enum
+    {
+        DefaultWorkers = 4,
+        MaxLinks = 65536
+    };
+
+    enum Durability
+    {
+        None,
+        PerFile,
+        Batched
+    };
+
+    struct Options
+    {
+        Options() :
+            workers(DefaultWorkers),
+            move(false),
+            hardlinks(true),
+            durability(None)
+        {}
+
+        int workers;
+        bool move;
+        bool hardlinks;
+        Durability durability;
+        Engine::Options engine;
+    };
+
+public:
+    Job(const Progress &progress,
+        const Interface::Holder &source, const Files &files,
+        const Interface::Holder &destination,
+        const Options &options = Options());
+    ~Job();
+
+    bool run();
+    inline void cancel() { m_statistics.cancel(); }
+
+    inline const Statistics &statistics() const { return m_statistics; }
+    /** Entries which could not be copied, moved or synced. */
+    inline size_t failed() const { return m_failed; }
+    const Error &lastError() const { return m_lastError; }
+
+private:
+    struct Task
+    {
+        Interface::Holder entry;
+        Interface::Holder directory;
+        Interface::Holder destination;
+        Task *parent;
+        off64_t size;
+        bool isDirectory;
+        bool failed;
+        bool renamed;
+    };
+
+    typedef ::EFC::List<Task> Tasks;
+
+    struct Link
+    {
+        Interface::Holder destination;
+        nlink_t left;
+        bool copied;
+    };
+
+    struct Sync
+    {
+        Interface::Holder directory;
+        int filesystem;
+    };
+
+    class Locker
+    {
+    public:
+        Locker(pthread_mutex_t &mutex) :
+            m_mutex(mutex)
+        {
+            ::pthread_mutex_lock(&m_mutex);
+        }
+        ~Locker()
+        {
+            ::pthread_mutex_unlock(&m_mutex);
+        }
+
+    private:
+        pthread_mutex_t &m_mutex;
+    };
+
+private:
+    void spawn(void *(*worker)(void *));
+    void finished();
+    static void *worker(void *job);
+    static void *syncWorker(void *job);
+
+    void add(const Interface::Holder &entry, const Interface::Holder &directory, Task *parent);
+    void scan(Task *task);
+    bool makeDirectory(Task *task);
+    bool copy(Task *task);
+    bool transfer(Task *task, Interface::Holder &destination);
+    bool done(Task *task);
+    bool sync(Task *task, const Interface::Holder &target);
+    void syncDestination();
+    void removeCopied();
+    void removeSources();
+    void fail(Task *task, const Error &error);
+
+private:
+    Statistics m_statistics;
+    Interface::Holder m_source;
+    Interface::Holder m_destination;
+    Options m_options;
+    std::atomic<size_t> m_failed;
+    Error m_lastError;
+
+    mutable pthread_mutex_t m_mutex;
+    pthread_cond_t m_changed;
+
+    Files m_files;
+    Tasks m_tasks;
+    ::EFC::List<Task *> m_pending;
+    ::EFC::List<Task *> m_ready;
+    ::EFC::List<Task *> m_removals;
+    ::EFC::Map<dev_t, int> m_filesystems;
+    ::EFC::Map<IIdentity::Key, Link> m_links;
+    ::EFC::List<Sync> m_syncs;
+    int m_scanning;
+    int m_running;
+    int m_active;
+};
+
+}}
+
+#endif /* LVFS_COPY_JOB_H_ */
@@ -0,0 +1,460 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_copy_Removal.h"
+
+#include <lvfs/IEntry>
+#include <lvfs/IDirectory>
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+
+namespace LVFS {
+namespace Copy {
+
+namespace {
+
+    inline void addMilliseconds(struct timespec &time, long ms)
+    {
+        time.tv_sec += ms / 1000;
+        time.tv_nsec += (ms % 1000) * 1000 * 1000;
+
+        if (time.tv_nsec >= 1000 * 1000 * 1000)
+        {
+            time.tv_nsec -= 1000 * 1000 * 1000;
+            ++time.tv_sec;
+        }
+    }
+
+    /* Half of the descriptors is left to the rest of the process */
+    size_t openLimit()
+    {
+        struct rlimit limit;
+
+        if (::getrlimit(RLIMIT_NOFILE, &limit) != 0)
+            return 512;
+        else if (limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur > 1024 * 1024)
+            return 512 * 1024;
+        else
+            return limit.rlim_cur / 2;
+    }
+
+}
+
+
+Removal::Removal(const Progress &progress,
+                 const Interface::Holder &directory, const Files &files,
+                 int workers) :
+    m_statistics(progress, Statistics::DefaultInterval, Statistics::Entries),
+    m_directory(directory),
+    m_files(files),
+    m_workers(workers),
+    m_failed(0),
+    m_running(0),
+    m_scanning(0),
+    m_open(0),
+    m_maxOpen(openLimit())
+{
+    ::pthread_mutex_init(&m_mutex, NULL);
+    ::pthread_cond_init(&m_changed, NULL);
+}
+
+Removal::~Removal()
+{
+    /* Directories left open by cancellation */
+    for (auto &i : m_nodes)
+    {
+        if (i.fd >= 0)
+            ::close(i.fd);
+
+        ::free(i.name);
+    }
+
+    ::pthread_cond_destroy(&m_changed);
+    ::pthread_mutex_destroy(&m_mutex);
+}
+
+bool Removal::run()
+{
+    IDirectory *directory = m_directory->as<IDirectory>();
+    const IEntry *entry;
+
+    m_statistics.start();
+
+    for (auto i : m_files)
+    {
+        m_statistics.addTotal(0);
+
+        if ((entry = i->as<IEntry>()) != NULL && std::strcmp(entry->schema(), "file") == 0)
+            add(NULL, entry->location());
+        else if (!m_statistics.aborted())
+            remove(directory, i);
+    }
+
+    spawn();
+
+    m_statistics.report(true);
+
+    if (m_lastError.isOk() && m_statistics.aborted())
+        m_lastError = Error(ECANCELED);
+
+    return m_lastError.isOk() && m_failed == 0;
+}
+
+void Removal::spawn()
+{
+    pthread_t *threads = new (std::nothrow) pthread_t [m_workers];
+    struct timespec timeout;
+    int started = 0;
+
+    if (LIKELY(threads != NULL))
+    {
+        Locker lock(m_mutex);
+
+        for (; started < m_workers; ++started)
+            if (::pthread_create(&threads[started], NULL, worker, this) != 0)
+                break;
+
+        m_running = started;
+
+        /* Workers can't report, it is done from here */
+        while (m_running > 0)
+        {
+            ::clock_gettime(CLOCK_REALTIME, &timeout);
+            addMilliseconds(timeout, Statistics::DefaultInterval);
+            ::pthread_cond_timedwait(&m_changed, &m_mutex, &timeout);
+
+            ::pthread_mutex_unlock(&m_mutex);
+            m_statistics.report();
+            ::pthread_mutex_lock(&m_mutex);
+        }
+    }
+
+    for (int i = 0; i < started; ++i)
+        ::pthread_join(threads[i], NULL);
+
+    delete [] threads;
+
+    if (started == 0)
+    {
+        m_running = 1;
+        worker(this);
+    }
+}
+
+void *Removal::worker(void *removal)
+{
+    Removal *self = static_cast<Removal *>(removal);
+    Node *node;
+
+    for (;;)
+    {
+        {
+            Locker lock(self->m_mutex);
+
+            while (self->m_queue.empty() && self->m_scanning > 0 && !self->m_statistics.aborted())
+                ::pthread_cond_wait(&self->m_changed, &self->m_mutex);
+
+            if (self->m_queue.empty() || self->m_statistics.aborted())
+                break;
+
+            node = self->m_queue.front();
+            self->m_queue.pop_front();
+            ++self->m_scanning;
+        }
+
+        self->scan(node);
+
+        Locker lock(self->m_mutex);
+        --self->m_scanning;
+        ::pthread_cond_broadcast(&self->m_changed);
+    }
+
+    Locker lock(self->m_mutex);
+
+    if (--self->m_running == 0)
+        ::pthread_cond_broadcast(&self->m_changed);
+
+    return NULL;
+}
+
+void Removal::add(Node *parent, const char *name)
+{
+    Node node = { parent, ::strdup(name), -1, 1, false };
+
+    if (UNLIKELY(node.name == NULL))
+    {
+        fail(Error(ENOMEM));
+
+        if (parent != NULL)
+        {
+            Locker lock(m_mutex);
+            parent->failed = true;
+        }
+
+        return;
+    }
+
+    Locker lock(m_mutex);
+
+    if (parent != NULL)
+        ++parent->pending;
+
+    m_nodes.push_back(node);
+
+    /* Depth first, see the class description */
+    m_queue.push_front(&m_nodes.back());
+    ::pthread_cond_broadcast(&m_changed);
+}
+
+bool Removal::locate(const Node *node, int &directory, const char *&name, char *path) const
+{
+    size_t len = 0;
+    size_t pos;
+
+    if (node->parent == NULL || node->parent->fd >= 0)
+    {
+        directory = node->parent ? node->parent->fd : AT_FDCWD;
+        name = node->name;
+        return true;
+    }
+
+    /* The parent is not kept open, the path goes from the root */
+    for (const Node *i = node; i != NULL && len < PATH_MAX; i = i->parent)
+        len += std::strlen(i->name) + 1;
+
+    if (len > PATH_MAX)
+    {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+
+    path[pos = len - 1] = 0;
+
+    for (const Node *i = node; i != NULL; i = i->parent)
+    {
+        pos -= std::strlen(i->name);
+        std::memcpy(path + pos, i->name, std::strlen(i->name));
+
+        if (pos > 0)
+            path[--pos] = '/';
+    }
+
+    directory = AT_FDCWD;
+    name = path;
+    return true;
+}
+
+void Removal::scan(Node *node)
+{
+    char path[PATH_MAX];
+    const char *name;
+    struct dirent *entry;
+    struct stat st;
+    bool directory;
+    int parent;
+    DIR *dir;
+    int fd;
+
+    if (!locate(node, parent, name, path) ||
+        (fd = ::openat(parent, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) < 0)
+    {
+        /* Roots may be files or symlinks, everything below is known to be a directory */
+        if (node->parent == NULL && (errno == ENOTDIR || errno == ELOOP))
+            if (::unlinkat(AT_FDCWD, node->name, 0) == 0)
+            {
+                m_statistics.addProcessedFile();
+                return;
+            }
+
+        fail(Error(errno));
+
+        {
+            Locker lock(m_mutex);
+            node->failed = true;
+        }
+
+        done(node);
+        return;
+    }
+
+    {
+        /* Children use it, while there are descriptors to spare */
+        Locker lock(m_mutex);
+
+        if (m_open < m_maxOpen && (node->fd = ::dup(fd)) >= 0)
+            ++m_open;
+    }
+
+    /* closedir() closes the descriptor, the node keeps its own */
+    if ((dir = ::fdopendir(fd)) == NULL)
+    {
+        fail(Error(errno));
+        ::close(fd);
+
+        {
+            Locker lock(m_mutex);
+            node->failed = true;
+        }
+
+        done(node);
+        return;
+    }
+
+    while ((entry = ::readdir(dir)) != NULL && !m_statistics.aborted())
+    {
+        if (entry->d_name[0] == '.' &&
+            (entry->d_name[1] == 0 || (entry->d_name[1] == '.' && entry->d_name[2] == 0)))
+        {
+            continue;
+        }
+
+        m_statistics.addTotal(0);
+
+        if (entry->d_type != DT_UNKNOWN)
+            directory = entry->d_type == DT_DIR;
+        else if (::fstatat(::dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+            directory = S_ISDIR(st.st_mode);
+        else
+            directory = false;
+
+        if (directory)
+            add(node, entry->d_name);
+        else if (::unlinkat(::dirfd(dir), entry->d_name, 0) == 0)
+        {
+            m_statistics.addProcessedFile();
+        }
+        else
+        {
+            fail(Error(errno));
+
+            Locker lock(m_mutex);
+            node->failed = true;
+        }
+    }
+
+    ::closedir(dir);
+    done(node);
+}
+
+void Removal::done(Node *node)
+{
+    char path[PATH_MAX];
+    const char *name;
+    int parent;
+
+    for (; node != NULL; node = node->parent)
+    {
+        {
+            Locker lock(m_mutex);
+
+            if (--node->pending > 0)
+                return;
+        }
+
+        /* All children are done, nobody else touches the node */
+        if (node->fd >= 0)
+        {
+            ::close(node->fd);
+            node->fd = -1;
+
+            Locker lock(m_mutex);
+            --m_open;
+        }
+
+        if (m_statistics.aborted())
+            continue;
+
+        if (!node->failed)
+            if (locate(node, parent, name, path) && ::unlinkat(parent, name, AT_REMOVEDIR) == 0)
+            {
+                m_statistics.addProcessedFile();
+                continue;
+            }
+            else
+            {
+                fail(Error(errno));
+                node->failed = true;
+            }
+
+        if (node->parent != NULL)
+        {
+            Locker lock(m_mutex);
+            node->parent->failed = true;
+        }
+    }
+}
+
+bool Removal::remove(IDirectory *directory, const Interface::Holder &entry)
+{
+    bool res = true;
+
+    if (IDirectory *dir = entry->as<IDirectory>())
+    {
+        /* Don't modify a directory while it is iterated */
+        Files children;
+
+        for (auto i = dir->begin(), end = dir->end(); i != end; ++i)
+        {
+            m_statistics.addTotal(0);
+            children.push_back(*i);
+        }
+
+        for (auto i : children)
+            if (m_statistics.aborted())
+                return false;
+            else
+                res = remove(dir, i) && res;
+    }
+
+    if (!res || m_statistics.aborted())
+        return false;
+
+    if (!directory->remove(entry))
+    {
+        fail(directory->lastError());
+        return false;
+    }
+
+    m_statistics.addProcessedFile();
+    m_statistics.report();
+
+    return true;
+}
+
+void Removal::fail(const Error &error)
+{
+    ++m_failed;
+
+    Locker lock(m_mutex);
+
+    if (m_lastError.isOk())
+        m_lastError = error;
+}
+
+}}
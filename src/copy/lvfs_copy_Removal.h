@@ -0,0 +1,144 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_COPY_REMOVAL_H_
+#define LVFS_COPY_REMOVAL_H_
+
+#include <atomic>
+#include <pthread.h>
+#include <efc/List>
+#include <lvfs/Interface>
+#include <lvfs/Error>
+#include <lvfs/copy/Statistics>
+
+
+namespace LVFS {
+namespace Copy {
+
+/**
+ * Removes a set of entries of one IDirectory, recursively.
+ *
+ * Local entries ("file" schema) are removed by Options::workers threads
+ * sharing a queue of directories: each directory is opened relative to
+ * the descriptor of its parent, its files are unlinkat()ed and its
+ * subdirectories queued. A directory is removed by the thread which
+ * finishes its last subdirectory, so the tree goes away bottom-up. The
+ * queue is LIFO, which keeps the number of open directories close to
+ * the depth of the tree times the number of workers. Directories kept
+ * open for their children never take more than half of RLIMIT_NOFILE,
+ * beyond that children are opened and removed by their paths.
+ *
+ * Other entries are removed through IDirectory::remove(), children
+ * first.
+ *
+ * Errors don't stop the job: the entry and its parents are left, the
+ * number of failures is counted and the first error is kept. Entries
+ * are counted by the file counters of statistics(), its unit is
+ * Statistics::Entries, so Progress::function() gets the number of
+ * entries removed since the previous call.
+ */
+class PLATFORM_MAKE_PUBLIC Removal
+{
+    PLATFORM_MAKE_NONCOPYABLE(Removal)
+    PLATFORM_MAKE_NONMOVEABLE(Removal)
+
+public:
+    typedef Statistics::Progress Progress;
+    typedef ::EFC::List<Interface::Holder> Files;
+
+    enum
+    {
+        DefaultWorkers = 4
+    };
+
+public:
+    Removal(const Progress &progress,
+            const Interface::Holder &directory, const Files &files,
+            int workers = DefaultWorkers);
+    ~Removal();
+
+    bool run();
+    inline void cancel() { m_statistics.cancel(); }
+
+    inline const Statistics &statistics() const { return m_statistics; }
+    /** Entries which could not be removed. */
+    inline size_t failed() const { return m_failed; }
+    const Error &lastError() const { return m_lastError; }
+
+private:
+    struct Node
+    {
+        Node *parent;
+        char *name;
+        int fd;
+        int pending;
+        bool failed;
+    };
+
+    typedef ::EFC::List<Node> Nodes;
+
+    class Locker
+    {
+    public:
+        Locker(pthread_mutex_t &mutex) :
+            m_mutex(mutex)
+        {
+            ::pthread_mutex_lock(&m_mutex);
+        }
+        ~Locker()
+        {
+            ::pthread_mutex_unlock(&m_mutex);
+        }
+
+    private:
+        pthread_mutex_t &m_mutex;
+    };
+
+private:
+    void spawn();
+    static void *worker(void *removal);
+
+    void add(Node *parent, const char *name);
+    bool locate(const Node *node, int &directory, const char *&name, char *path) const;
+    void scan(Node *node);
+    void done(Node *node);
+    bool remove(IDirectory *directory, const Interface::Holder &entry);
+    void fail(const Error &error);
+
+private:
+    Statistics m_statistics;
+    Interface::Holder m_directory;
+    Files m_files;
+    int m_workers;
+    std::atomic<size_t> m_failed;
+    Error m_lastError;
+
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_changed;
+    Nodes m_nodes;
+    ::EFC::List<Node *> m_queue;
+    int m_running;
+    int m_scanning;
+    size_t m_open;
+    size_t m_maxOpen;
+};
+
+}}
+
+#endif /* LVFS_COPY_REMOVAL_H_ */
@@ -0,0 +1,64 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_copy_Settings.h"
+
+#include <brolly/assert.h>
+
+
+namespace LVFS {
+namespace Copy {
+
+namespace {
+    static Settings *s_instance;
+}
+
+
+Settings::Settings() :
+    ::LVFS::Settings::Scope("Copy"),
+    m_rotationalDeviceJobs("RotationalDeviceJobs", DefaultRotationalDeviceJobs, this),
+    m_solidStateDeviceJobs("SolidStateDeviceJobs", DefaultSolidStateDeviceJobs, this),
+    m_removableDeviceJobs("RemovableDeviceJobs", DefaultRemovableDeviceJobs, this),
+    m_otherDeviceJobs("OtherDeviceJobs", DefaultOtherDeviceJobs, this),
+    m_chunkSize("ChunkSize", DefaultChunkSize, this),
+    m_inFlight("InFlight", DefaultInFlight, this)
+{
+    ASSERT(s_instance == NULL);
+    s_instance = this;
+
+    manage(&m_rotationalDeviceJobs);
+    manage(&m_solidStateDeviceJobs);
+    manage(&m_removableDeviceJobs);
+    manage(&m_otherDeviceJobs);
+    manage(&m_chunkSize);
+    manage(&m_inFlight);
+}
+
+Settings::~Settings()
+{
+    ASSERT(s_instance == this);
+    s_instance = NULL;
+}
+
+const Settings *Settings::instance()
+{
+    return s_instance;
+}
+
+}}
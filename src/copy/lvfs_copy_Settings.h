@@ -0,0 +1,78 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_COPY_SETTINGS_H_
+#define LVFS_COPY_SETTINGS_H_
+
+#include <lvfs/settings/Scope>
+#include <lvfs/settings/IntOption>
+
+
+namespace LVFS {
+namespace Copy {
+
+/**
+ * Tunables of the copy machinery. Module manages an instance of it
+ * in its Settings::Instance, so values can be overridden by the user.
+ */
+class PLATFORM_MAKE_PUBLIC Settings : public ::LVFS::Settings::Scope
+{
+    PLATFORM_MAKE_NONCOPYABLE(Settings)
+    PLATFORM_MAKE_NONMOVEABLE(Settings)
+
+public:
+    enum
+    {
+        DefaultRotationalDeviceJobs = 1,
+        DefaultSolidStateDeviceJobs = 4,
+        DefaultRemovableDeviceJobs = 1,
+        DefaultOtherDeviceJobs = 2,
+        DefaultChunkSize = 0,
+        DefaultInFlight = 0
+    };
+
+public:
+    Settings();
+    virtual ~Settings();
+
+    /** Settings of the current Module, NULL if there is none. */
+    static const Settings *instance();
+
+    /* Concurrent transfers allowed per device */
+    inline int rotationalDeviceJobs() const { return m_rotationalDeviceJobs.value(); }
+    inline int solidStateDeviceJobs() const { return m_solidStateDeviceJobs.value(); }
+    inline int removableDeviceJobs() const { return m_removableDeviceJobs.value(); }
+    inline int otherDeviceJobs() const { return m_otherDeviceJobs.value(); }
+
+    /* Fixed transfer parameters, 0 lets Copy::Tuner choose them */
+    inline int chunkSize() const { return m_chunkSize.value(); }
+    inline int inFlight() const { return m_inFlight.value(); }
+
+private:
+    ::LVFS::Settings::IntOption m_rotationalDeviceJobs;
+    ::LVFS::Settings::IntOption m_solidStateDeviceJobs;
+    ::LVFS::Settings::IntOption m_removableDeviceJobs;
+    ::LVFS::Settings::IntOption m_otherDeviceJobs;
+    ::LVFS::Settings::IntOption m_chunkSize;
+    ::LVFS::Settings::IntOption m_inFlight;
+};
+
+}}
+
+#endif /* LVFS_COPY_SETTINGS_H_ */
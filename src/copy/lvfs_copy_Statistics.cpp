@@ -0,0 +1,106 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_copy_Statistics.h"
+
+
+namespace LVFS {
+namespace Copy {
+
+namespace {
+    /* Weight of the last interval in the smoothed throughput */
+    static const double Smoothing = 0.2;
+}
+
+
+Statistics::Statistics(const Progress &progress, int interval, Unit unit) :
+    m_progress(progress),
+    m_owner(::pthread_self()),
+    m_interval(interval),
+    m_unit(unit),
+    m_cancelled(false),
+    m_totalBytes(0),
+    m_processedBytes(0),
+    m_totalFiles(0),
+    m_processedFiles(0),
+    m_avoidedBytes(0),
+    m_throughput(0),
+    m_averageThroughput(0),
+    m_reported(0),
+    m_reportedTime(Tuner::now())
+{}
+
+Statistics::~Statistics()
+{}
+
+void Statistics::start()
+{
+    m_owner = ::pthread_self();
+    m_reportedTime = Tuner::now();
+}
+
+bool Statistics::report(bool force)
+{
+    if (!::pthread_equal(m_owner, ::pthread_self()))
+        return false;
+
+    long long time = Tuner::now();
+    long long elapsed = time - m_reportedTime;
+
+    if (elapsed < m_interval * 1000000LL && !force)
+        return false;
+
+    off64_t processed = processedUnits();
+    off64_t delta = processed - m_reported;
+
+    if (elapsed > 0)
+    {
+        double throughput = delta * 1000000000.0 / elapsed;
+
+        m_throughput = throughput;
+
+        if (m_averageThroughput == 0)
+            m_averageThroughput = throughput;
+        else
+            m_averageThroughput = Smoothing * throughput + (1 - Smoothing) * m_averageThroughput;
+    }
+
+    m_reported = processed;
+    m_reportedTime = time;
+
+    if (delta > 0)
+        m_progress.function(m_progress.arg, delta);
+
+    return true;
+}
+
+time_t Statistics::eta() const
+{
+    double throughput = m_averageThroughput;
+    off64_t left = totalUnits() - processedUnits();
+
+    if (throughput <= 0)
+        return -1;
+    else if (left <= 0)
+        return 0;
+    else
+        return left / throughput;
+}
+
+}}
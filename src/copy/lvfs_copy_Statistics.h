@@ -0,0 +1,127 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_COPY_STATISTICS_H_
+#define LVFS_COPY_STATISTICS_H_
+
+#include <atomic>
+#include <ctime>
+#include <pthread.h>
+#include <lvfs/IDirectory>
+#include <lvfs/copy/Tuner>
+
+
+namespace LVFS {
+namespace Copy {
+
+/**
+ * Counters of a transfer shared by all copy paths.
+ *
+ * add*() and all accessors are lock-free and may be used from any
+ * thread. report() invokes Progress::function() with the number of
+ * bytes processed since the previous call, at most once per interval,
+ * and only in the thread which called start() (the one which created
+ * the object until then), so workers may call it freely.
+ *
+ * With Entries as the unit Progress::function(), throughput() and eta()
+ * go by the file counters instead, for jobs which don't move bytes.
+ *
+ * tuner() holds the transfer parameters chosen for the job.
+ */
+class PLATFORM_MAKE_PUBLIC Statistics
+{
+    PLATFORM_MAKE_NONCOPYABLE(Statistics)
+    PLATFORM_MAKE_NONMOVEABLE(Statistics)
+
+public:
+    typedef IDirectory::Progress Progress;
+
+    enum
+    {
+        DefaultInterval = 100 /* ms */
+    };
+
+    enum Unit
+    {
+        Bytes,
+        Entries
+    };
+
+public:
+    Statistics(const Progress &progress, int interval = DefaultInterval, Unit unit = Bytes);
+    ~Statistics();
+
+    /** Makes the calling thread the one which reports progress. */
+    void start();
+
+    inline bool aborted() const { return m_cancelled || m_progress.aborted; }
+    inline void cancel() { m_cancelled = true; }
+
+    inline void addTotal(off64_t bytes, size_t files = 1) { m_totalBytes += bytes; m_totalFiles += files; }
+    inline void addProcessed(off64_t bytes) { m_processedBytes += bytes; }
+    inline void addProcessedFile() { ++m_processedFiles; }
+    /** Bytes which count as processed without being transferred. */
+    inline void addAvoided(off64_t bytes) { m_avoidedBytes += bytes; m_processedBytes += bytes; }
+
+    bool report(bool force = false);
+
+    inline off64_t totalBytes() const { return m_totalBytes; }
+    inline off64_t processedBytes() const { return m_processedBytes; }
+    inline size_t totalFiles() const { return m_totalFiles; }
+    inline size_t processedFiles() const { return m_processedFiles; }
+    inline off64_t avoidedBytes() const { return m_avoidedBytes; }
+
+    /** Units per second during the last interval. */
+    inline double throughput() const { return m_throughput; }
+    /** Exponentially smoothed units per second. */
+    inline double averageThroughput() const { return m_averageThroughput; }
+    /** Estimated seconds left, -1 if unknown yet. */
+    time_t eta() const;
+
+    inline Tuner &tuner() { return m_tuner; }
+    inline const Tuner &tuner() const { return m_tuner; }
+
+private:
+    inline off64_t totalUnits() const { return m_unit == Bytes ? m_totalBytes.load() : static_cast<off64_t>(m_totalFiles); }
+    inline off64_t processedUnits() const { return m_unit == Bytes ? m_processedBytes.load() : static_cast<off64_t>(m_processedFiles); }
+
+private:
+    Progress m_progress;
+    pthread_t m_owner;
+    int m_interval;
+    Unit m_unit;
+    volatile bool m_cancelled;
+
+    std::atomic<off64_t> m_totalBytes;
+    std::atomic<off64_t> m_processedBytes;
+    std::atomic<size_t> m_totalFiles;
+    std::atomic<size_t> m_processedFiles;
+    std::atomic<off64_t> m_avoidedBytes;
+    std::atomic<double> m_throughput;
+    std::atomic<double> m_averageThroughput;
+
+    off64_t m_reported;
+    long long m_reportedTime;
+
+    Tuner m_tuner;
+};
+
+}}
+
+#endif /* LVFS_COPY_STATISTICS_H_ */
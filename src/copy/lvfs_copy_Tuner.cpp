@@ -0,0 +1,166 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_copy_Tuner.h"
+#include "lvfs_copy_Settings.h"
+
+#include <algorithm>
+#include <ctime>
+
+
+namespace LVFS {
+namespace Copy {
+
+const double Tuner::Tolerance = 0.05;
+
+
+Tuner::Tuner() :
+    m_chunkSize(DefaultChunkSize),
+    m_inFlight(DefaultMaxInFlight),
+    m_maxInFlight(DefaultMaxInFlight),
+    m_chunkSizeFixed(false),
+    m_inFlightFixed(false),
+    m_bytes(0),
+    m_latency(0),
+    m_chunks(0),
+    m_periodStart(now()),
+    m_previous(0),
+    m_tuningChunkSize(true),
+    m_chunkSizeDirection(1),
+    m_inFlightDirection(-1)
+{
+    ::pthread_mutex_init(&m_mutex, NULL);
+
+    if (const Settings *settings = Settings::instance())
+    {
+        if (settings->chunkSize() > 0)
+        {
+            m_chunkSize = settings->chunkSize();
+            m_chunkSizeFixed = true;
+            m_tuningChunkSize = false;
+        }
+
+        if (settings->inFlight() > 0)
+        {
+            m_inFlight = m_maxInFlight = settings->inFlight();
+            m_inFlightFixed = true;
+        }
+    }
+}
+
+Tuner::~Tuner()
+{
+    ::pthread_mutex_destroy(&m_mutex);
+}
+
+void Tuner::setMaxInFlight(int value)
+{
+    value = std::max(value, 1);
+    m_maxInFlight = value;
+
+    /* Tuning starts from all workers busy and goes down */
+    if (!m_inFlightFixed || m_inFlight > value)
+        m_inFlight = value;
+}
+
+void Tuner::sample(size_t bytes, long long nanoseconds)
+{
+    long long time;
+
+    m_bytes += bytes;
+    m_latency += nanoseconds;
+    ++m_chunks;
+
+    if ((m_chunkSizeFixed && m_inFlightFixed) ||
+        (time = now()) - m_periodStart < Period * 1000000LL ||
+        ::pthread_mutex_trylock(&m_mutex) != 0)
+    {
+        return;
+    }
+
+    if (time - m_periodStart >= Period * 1000000LL)
+        step(time);
+
+    ::pthread_mutex_unlock(&m_mutex);
+}
+
+long long Tuner::now()
+{
+    struct timespec time;
+    ::clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+
+void Tuner::step(long long time)
+{
+    long long bytes = m_bytes.exchange(0);
+    long long latency = m_latency.exchange(0);
+    long long chunks = m_chunks.exchange(0);
+    double throughput = bytes * 1e9 / (time - m_periodStart);
+    size_t chunkSize;
+    int inFlight;
+
+    m_periodStart = time;
+
+    if (chunks == 0)
+        return;
+
+    if (!m_chunkSizeFixed && latency / chunks > MaxLatency * 1000000LL)
+    {
+        m_chunkSize = std::max<size_t>(m_chunkSize / 2, MinChunkSize);
+        m_chunkSizeDirection = -1;
+        m_previous = 0;
+        return;
+    }
+
+    /* No gain, go back and try the other parameter */
+    if (m_previous > 0 && throughput <= m_previous * (1 + Tolerance))
+    {
+        if (m_tuningChunkSize)
+            m_chunkSizeDirection = -m_chunkSizeDirection;
+        else
+            m_inFlightDirection = -m_inFlightDirection;
+
+        if (!(m_tuningChunkSize ? m_inFlightFixed : m_chunkSizeFixed))
+            m_tuningChunkSize = !m_tuningChunkSize;
+    }
+
+    m_previous = throughput;
+
+    if (m_tuningChunkSize)
+    {
+        chunkSize = m_chunkSizeDirection > 0 ? m_chunkSize * 2 : m_chunkSize / 2;
+
+        if (chunkSize < MinChunkSize || chunkSize > MaxChunkSize)
+            m_chunkSizeDirection = -m_chunkSizeDirection;
+        else
+            m_chunkSize = chunkSize;
+    }
+    else
+    {
+        inFlight = m_inFlight + m_inFlightDirection;
+
+        if (inFlight < 1 || inFlight > m_maxInFlight)
+            m_inFlightDirection = -m_inFlightDirection;
+        else
+            m_inFlight = inFlight;
+    }
+}
+
+}}
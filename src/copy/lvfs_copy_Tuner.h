@@ -0,0 +1,107 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_COPY_TUNER_H_
+#define LVFS_COPY_TUNER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <pthread.h>
+#include <platform/utils.h>
+
+
+namespace LVFS {
+namespace Copy {
+
+/**
+ * Chooses the chunk size and the number of transfers in flight of a job.
+ *
+ * Copy paths call sample() with the size and the latency of every
+ * chunk. Once per Period the throughput of the whole job is compared
+ * with the one of the previous period: while it grows by more than
+ * Tolerance the same parameter keeps moving in the same direction
+ * (chunk size doubled or halved, in flight count by one), otherwise
+ * the direction is reversed and the other parameter is tried next.
+ * Chunks slower than MaxLatency halve the chunk size at once, so that
+ * slow devices keep progress and cancellation responsive.
+ *
+ * Non-zero ChunkSize and InFlight of Copy::Settings fix the respective
+ * parameter. All functions may be called from any thread.
+ */
+class PLATFORM_MAKE_PUBLIC Tuner
+{
+    PLATFORM_MAKE_NONCOPYABLE(Tuner)
+    PLATFORM_MAKE_NONMOVEABLE(Tuner)
+
+public:
+    enum
+    {
+        MinChunkSize = 64 * 1024,
+        MaxChunkSize = 16 * 1024 * 1024,
+        DefaultChunkSize = 1024 * 1024,
+        DefaultMaxInFlight = 4,
+        Period = 250 /* ms */,
+        MaxLatency = 500 /* ms */
+    };
+
+    static const double Tolerance;
+
+public:
+    Tuner();
+    ~Tuner();
+
+    inline size_t chunkSize() const { return m_chunkSize; }
+    inline int inFlight() const { return m_inFlight; }
+    inline int maxInFlight() const { return m_maxInFlight; }
+
+    inline bool isChunkSizeFixed() const { return m_chunkSizeFixed; }
+    inline bool isInFlightFixed() const { return m_inFlightFixed; }
+
+    /** Upper bound of inFlight(), the number of workers of the job. */
+    void setMaxInFlight(int value);
+
+    void sample(size_t bytes, long long nanoseconds);
+
+    /** Monotonic time in nanoseconds, the clock of all copy timings. */
+    static long long now();
+
+private:
+    void step(long long time);
+
+private:
+    std::atomic<size_t> m_chunkSize;
+    std::atomic<int> m_inFlight;
+    std::atomic<int> m_maxInFlight;
+    bool m_chunkSizeFixed;
+    bool m_inFlightFixed;
+
+    pthread_mutex_t m_mutex;
+    std::atomic<long long> m_bytes;
+    std::atomic<long long> m_latency;
+    std::atomic<long long> m_chunks;
+    std::atomic<long long> m_periodStart;
+    double m_previous;
+    bool m_tuningChunkSize;
+    int m_chunkSizeDirection;
+    int m_inFlightDirection;
+};
+
+}}
+
+#endif /* LVFS_COPY_TUNER_H_ */
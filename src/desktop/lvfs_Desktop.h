@@ -137,6 +137,8 @@ public:
     Interface::Holder applications(const IType *type) const;
     Interface::Holder typeOfFile(const char *filename, IconType iconType = AppIconIfNoTypeIcon) const;
     Interface::Holder typeOfFile(const IEntry *file, IconType iconType = AppIconIfNoTypeIcon) const;
+    /** Sniffs the content of \a file, the name is used only if that tells nothing. */
+    Interface::Holder typeOfContent(const IEntry *file, IconType iconType = AppIconIfNoTypeIcon) const;
     Interface::Holder typeOfDirectory() const;
     Interface::Holder typeOfUnknownFile() const;
 
@@ -0,0 +1,126 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_LazyType.h"
+#include "lvfs_Desktop.h"
+
+#include <lvfs/Module>
+
+#include <cstdlib>
+#include <cstring>
+#include <pthread.h>
+
+
+namespace LVFS {
+
+namespace {
+    static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+}
+
+
+LazyType::LazyType(const char *title, unsigned char kind) :
+    m_title(::strdup(title)),
+    m_kind(kind),
+    m_tier(Kind)
+{}
+
+LazyType::~LazyType()
+{
+    ::free(m_title);
+}
+
+void LazyType::sniff(const IEntry *entry)
+{
+    if (isDirectory() || tier() == Content)
+        return;
+
+    Interface::Holder type(Module::desktop().typeOfContent(entry));
+
+    if (type.isValid())
+    {
+        ::pthread_mutex_lock(&s_mutex);
+
+        if (tier() != Content)
+        {
+            m_byContent = type;
+            m_tier = Content;
+        }
+
+        ::pthread_mutex_unlock(&s_mutex);
+    }
+}
+
+const char *LazyType::name() const
+{
+    if (const IType *res = type())
+        return res->name();
+
+    return isDirectory() ? Module::DirectoryTypeName : "";
+}
+
+Interface::Holder LazyType::icon() const
+{
+    if (const IType *res = type())
+        return res->icon();
+
+    return Interface::Holder();
+}
+
+const char *LazyType::description() const
+{
+    if (const IType *res = type())
+        return res->description();
+
+    return "";
+}
+
+const IType *LazyType::type() const
+{
+    /* Resolved ones are never replaced, so they outlive their users */
+    switch (tier())
+    {
+        case Content:
+            return m_byContent->as<IType>();
+
+        case Name:
+            return m_byName->as<IType>();
+
+        default:
+            break;
+    }
+
+    Interface::Holder type(isDirectory() ? Module::desktop().typeOfDirectory() : Module::desktop().typeOfFile(m_title));
+
+    if (UNLIKELY(!type.isValid()))
+        return NULL;
+
+    ::pthread_mutex_lock(&s_mutex);
+
+    if (tier() == Kind)
+    {
+        m_byName = type;
+        m_tier = Name;
+    }
+
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return tier() == Content ? m_byContent->as<IType>() : m_byName->as<IType>();
+}
+
+}
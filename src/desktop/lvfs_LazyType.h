@@ -0,0 +1,82 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_LAZYTYPE_H_
+#define LVFS_LAZYTYPE_H_
+
+#include <atomic>
+#include <dirent.h>
+#include <lvfs/IType>
+#include <lvfs/IEntry>
+
+
+namespace LVFS {
+
+/**
+ * IType of a local entry, resolved in tiers as late as possible.
+ *
+ * Listings create it with the d_type given by getdents(), which is
+ * enough for isDirectory(); DT_UNKNOWN has to be resolved by the
+ * caller (fstatat()) beforehand. The first name(), icon() or
+ * description() resolves the MIME type by the title of the entry.
+ * The content is sniffed by sniff() only.
+ *
+ * May be used from any thread.
+ */
+class PLATFORM_MAKE_PUBLIC LazyType : public Implements<IType>
+{
+public:
+    enum Tier
+    {
+        Kind,
+        Name,
+        Content
+    };
+
+public:
+    LazyType(const char *title, unsigned char kind);
+    virtual ~LazyType();
+
+    inline unsigned char kind() const { return m_kind; }
+    inline bool isDirectory() const { return m_kind == DT_DIR; }
+    inline Tier tier() const { return static_cast<Tier>(m_tier.load()); }
+
+    /** Resolves the type by the content of \a entry, once. */
+    void sniff(const IEntry *entry);
+
+    /* IType */
+
+    virtual const char *name() const;
+    virtual Interface::Holder icon() const;
+    virtual const char *description() const;
+
+private:
+    const IType *type() const;
+
+private:
+    char *m_title;
+    unsigned char m_kind;
+    mutable std::atomic<int> m_tier;
+    mutable Interface::Holder m_byName;
+    Interface::Holder m_byContent;
+};
+
+}
+
+#endif /* LVFS_LAZYTYPE_H_ */
@@ -35,6 +35,7 @@ namespace LVFS {
 
 #include <lvfs/IEntry>
 #include <lvfs/Module>
+#include <lvfs/BufferPool>
 
 #include <brolly/assert.h>
 #include <efc/StateMachine>
@@ -391,28 +392,44 @@ Interface::Holder Desktop::typeOfFile(const IEntry *entry, IconType iconType) co
     const char *mimeType = xdg_mime_get_mime_type_from_file_name(entry->title());
 
     if (mimeType == XDG_MIME_TYPE_UNKNOWN)
+        return typeOfContent(entry, iconType);
+
+    if (strcmp(mimeType, XDG_MIME_TYPE_EMPTY) == 0)
+        mimeType = XDG_MIME_TYPE_TEXTPLAIN;
+
+    return loadMimeType(mimeType, iconType);
+}
+
+Interface::Holder Desktop::typeOfContent(const IEntry *entry, IconType iconType) const
+{
+    ASSERT(entry != NULL);
+    const char *mimeType = XDG_MIME_TYPE_UNKNOWN;
+    Interface::Holder file(entry->open(IStream::Read));
+
+    if (file.isValid())
     {
-        Interface::Holder file(entry->open(IStream::Read));
+        ssize_t len = xdg_mime_get_max_buffer_extents();
+        BufferPool::Buffer buffer(len);
 
-        if (file.isValid())
+        if (LIKELY(buffer.data() != NULL))
         {
-            ssize_t len = xdg_mime_get_max_buffer_extents();
-            ::EFC::ScopedPointer<char> buffer(new (std::nothrow) char [len]);
-
-            if (LIKELY(buffer != NULL))
-            {
-                len = file->as<IStream>()->read(buffer.get(), len);
+            len = file->as<IStream>()->read(buffer.data(), len);
 
-                if (len > 0)
-                    mimeType = xdg_mime_get_mime_type_for_data(buffer.get(), len, NULL);
-            }
+            if (len > 0)
+                mimeType = xdg_mime_get_mime_type_for_data(buffer.data(), len, NULL);
         }
     }
 
     if (strcmp(mimeType, XDG_MIME_TYPE_UNKNOWN) == 0 ||
         strcmp(mimeType, XDG_MIME_TYPE_EMPTY) == 0)
     {
-        mimeType = XDG_MIME_TYPE_TEXTPLAIN;
+        mimeType = xdg_mime_get_mime_type_from_file_name(entry->title());
+
+        if (strcmp(mimeType, XDG_MIME_TYPE_UNKNOWN) == 0 ||
+            strcmp(mimeType, XDG_MIME_TYPE_EMPTY) == 0)
+        {
+            mimeType = XDG_MIME_TYPE_TEXTPLAIN;
+        }
     }
 
     return loadMimeType(mimeType, iconType);
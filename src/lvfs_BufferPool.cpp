@@ -0,0 +1,211 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_BufferPool.h"
+
+#include <efc/List>
+#include <efc/Map>
+
+#include <cstdlib>
+#include <pthread.h>
+#include <sys/mman.h>
+
+
+namespace LVFS {
+
+namespace {
+
+    static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+    static pthread_cond_t s_released = PTHREAD_COND_INITIALIZER;
+    static ::EFC::Map<size_t, ::EFC::List<char *>> s_free;
+    static size_t s_limit = BufferPool::DefaultLimit;
+    static size_t s_used = 0;
+    static size_t s_cached = 0;
+
+
+    inline size_t classSize(size_t size)
+    {
+        size_t res = BufferPool::Alignment;
+
+        while (res < size)
+            res <<= 1;
+
+        return res;
+    }
+
+    char *allocate(size_t size)
+    {
+        void *res;
+
+        if (size >= BufferPool::HugePageSize)
+        {
+            if (::posix_memalign(&res, BufferPool::HugePageSize, size) != 0)
+                return NULL;
+#ifdef MADV_HUGEPAGE
+            /* Just a hint, kernels without THP ignore it */
+            ::madvise(res, size, MADV_HUGEPAGE);
+#endif
+        }
+        else if (::posix_memalign(&res, BufferPool::Alignment, size) != 0)
+            return NULL;
+
+        return static_cast<char *>(res);
+    }
+
+    /* Frees kept buffers until "size" more bytes fit into the limit */
+    void shrink(size_t size)
+    {
+        for (auto i = s_free.begin(); i != s_free.end() && s_used + s_cached + size > s_limit; ++i)
+            for (auto &list = (*i).second; !list.empty() && s_used + s_cached + size > s_limit; list.pop_front())
+            {
+                ::free(list.front());
+                s_cached -= (*i).first;
+            }
+    }
+
+}
+
+
+BufferPool::Buffer::Buffer(size_t size) :
+    m_data(acquire(size)),
+    m_size(size)
+{}
+
+BufferPool::Buffer::~Buffer()
+{
+    if (m_data != NULL)
+        release(m_data, m_size);
+}
+
+char *BufferPool::acquire(size_t size)
+{
+    size_t cls = classSize(size);
+    char *res = NULL;
+
+    ::pthread_mutex_lock(&s_mutex);
+
+    for (;;)
+    {
+        auto i = s_free.find(cls);
+
+        if (i != s_free.end() && !(*i).second.empty())
+        {
+            res = (*i).second.front();
+            (*i).second.pop_front();
+            s_cached -= cls;
+            break;
+        }
+
+        if (s_used + s_cached + cls > s_limit)
+            shrink(cls);
+
+        if (s_used + s_cached + cls <= s_limit || s_used == 0)
+            break;
+
+        ::pthread_cond_wait(&s_released, &s_mutex);
+    }
+
+    s_used += cls;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    if (res == NULL && (res = allocate(cls)) == NULL)
+    {
+        ::pthread_mutex_lock(&s_mutex);
+        s_used -= cls;
+        ::pthread_cond_broadcast(&s_released);
+        ::pthread_mutex_unlock(&s_mutex);
+    }
+
+    return res;
+}
+
+void BufferPool::release(char *buffer, size_t size)
+{
+    size_t cls = classSize(size);
+
+    ::pthread_mutex_lock(&s_mutex);
+
+    s_used -= cls;
+
+    if (s_used + s_cached + cls <= s_limit)
+    {
+        s_free[cls].push_back(buffer);
+        s_cached += cls;
+    }
+    else
+        /* The limit has been lowered or an oversized request was served */
+        ::free(buffer);
+
+    ::pthread_cond_broadcast(&s_released);
+    ::pthread_mutex_unlock(&s_mutex);
+}
+
+size_t BufferPool::limit()
+{
+    ::pthread_mutex_lock(&s_mutex);
+    size_t res = s_limit;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return res;
+}
+
+void BufferPool::setLimit(size_t limit)
+{
+    ::pthread_mutex_lock(&s_mutex);
+
+    s_limit = limit;
+    shrink(0);
+    ::pthread_cond_broadcast(&s_released);
+
+    ::pthread_mutex_unlock(&s_mutex);
+}
+
+size_t BufferPool::used()
+{
+    ::pthread_mutex_lock(&s_mutex);
+    size_t res = s_used;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return res;
+}
+
+size_t BufferPool::cached()
+{
+    ::pthread_mutex_lock(&s_mutex);
+    size_t res = s_cached;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return res;
+}
+
+void BufferPool::trim()
+{
+    ::pthread_mutex_lock(&s_mutex);
+
+    for (auto &i : s_free)
+        for (auto &j : i.second)
+            ::free(j);
+
+    s_free.clear();
+    s_cached = 0;
+
+    ::pthread_mutex_unlock(&s_mutex);
+}
+
+}
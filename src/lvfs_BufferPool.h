@@ -0,0 +1,90 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_BUFFERPOOL_H_
+#define LVFS_BUFFERPOOL_H_
+
+#include <cstddef>
+#include <platform/utils.h>
+
+
+namespace LVFS {
+
+/**
+ * Process-wide pool of transfer buffers.
+ *
+ * Sizes are rounded up to a power of two of at least Alignment bytes
+ * and buffers are aligned to Alignment, so they can be used with
+ * O_DIRECT. Buffers of HugePageSize and more are aligned to it and
+ * advised MADV_HUGEPAGE.
+ *
+ * Released buffers are kept for reuse. Buffers in use and kept ones
+ * together never exceed limit(): acquire() frees kept buffers of other
+ * sizes first and then blocks until enough is released. A request
+ * which doesn't fit at all is served when nothing else is in use.
+ */
+class PLATFORM_MAKE_PUBLIC BufferPool
+{
+public:
+    enum
+    {
+        Alignment = 4096,
+        HugePageSize = 2 * 1024 * 1024
+    };
+
+    static const size_t DefaultLimit = 256 * 1024 * 1024;
+
+    /**
+     * Buffer of the pool held for the lifetime of the object,
+     * data() is NULL if there was no memory.
+     */
+    class PLATFORM_MAKE_PUBLIC Buffer
+    {
+        PLATFORM_MAKE_NONCOPYABLE(Buffer)
+        PLATFORM_MAKE_NONMOVEABLE(Buffer)
+
+    public:
+        Buffer(size_t size);
+        ~Buffer();
+
+        inline char *data() const { return m_data; }
+        inline size_t size() const { return m_size; }
+
+    private:
+        char *m_data;
+        size_t m_size;
+    };
+
+public:
+    static char *acquire(size_t size);
+    static void release(char *buffer, size_t size);
+
+    static size_t limit();
+    static void setLimit(size_t limit);
+
+    /** Bytes handed out and not released yet. */
+    static size_t used();
+    /** Bytes kept for reuse. */
+    static size_t cached();
+    static void trim();
+};
+
+}
+
+#endif /* LVFS_BUFFERPOOL_H_ */
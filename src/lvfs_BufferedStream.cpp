@@ -0,0 +1,267 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_BufferedStream.h"
+
+#include <brolly/assert.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace LVFS {
+
+BufferedStream::BufferedStream(const Interface::Holder &original, size_t bufferSize) :
+    ExtendsBy<IStream>(original),
+    m_stream(original->as<IStream>()),
+    m_buffer(static_cast<char *>(::malloc(bufferSize))),
+    m_size(m_buffer == NULL ? 0 : bufferSize),
+    m_pos(0),
+    m_len(0),
+    m_writing(false),
+    m_advise(Normal)
+{
+    ASSERT(m_stream != NULL);
+}
+
+BufferedStream::~BufferedStream()
+{
+    if (m_writing)
+        flushWriteBehind();
+
+    ::free(m_buffer);
+}
+
+size_t BufferedStream::read(void *buffer, size_t size)
+{
+    char *dest = static_cast<char *>(buffer);
+    size_t res = 0;
+    size_t len;
+
+    if (m_writing)
+    {
+        if (!flushWriteBehind())
+            return 0;
+
+        m_writing = false;
+    }
+
+    if (m_pos < m_len)
+    {
+        len = std::min(size, m_len - m_pos);
+        ::memcpy(dest, m_buffer + m_pos, len);
+        m_pos += len;
+        res = len;
+    }
+
+    while (res < size)
+    {
+        len = size - res;
+
+        if (len >= (m_advise == NoReuse ? m_size / 4 : m_size))
+        {
+            /* Whatever is left in the buffer would be stale after this */
+            if (!dropReadAhead())
+                return res;
+
+            return res + directRead(dest + res, len);
+        }
+
+        m_pos = 0;
+        m_len = m_stream->read(m_buffer, readAhead(len));
+
+        if (m_len == 0)
+        {
+            m_lastError = m_stream->lastError();
+            break;
+        }
+
+        len = std::min(len, m_len);
+        ::memcpy(dest + res, m_buffer, len);
+        m_pos = len;
+        res += len;
+    }
+
+    return res;
+}
+
+size_t BufferedStream::write(const void *buffer, size_t size)
+{
+    const char *src = static_cast<const char *>(buffer);
+
+    if (!m_writing)
+    {
+        if (!dropReadAhead())
+            return 0;
+
+        m_writing = true;
+    }
+
+    if (m_len + size > m_size && !flushWriteBehind())
+        return 0;
+
+    if (size >= m_size)
+        return directWrite(src, size) ? size : 0;
+
+    ::memcpy(m_buffer + m_len, src, size);
+    m_len += size;
+
+    return size;
+}
+
+bool BufferedStream::advise(off64_t offset, off64_t len, Advise advise)
+{
+    if (offset == 0 && len == 0)
+        m_advise = advise;
+
+    if (advise == DontNeed && !m_writing && !dropReadAhead())
+        return false;
+
+    return m_stream->advise(offset, len, advise);
+}
+
+bool BufferedStream::seek(off64_t offset, Whence whence)
+{
+    if (m_writing)
+    {
+        if (!flushWriteBehind())
+            return false;
+
+        m_writing = false;
+    }
+    else if (m_len > 0)
+    {
+        if (whence == FromCurrent)
+        {
+            /* Stay inside of the read-ahead buffer if we can */
+            if (offset >= -static_cast<off64_t>(m_pos) && offset <= static_cast<off64_t>(m_len - m_pos))
+            {
+                m_pos += offset;
+                return true;
+            }
+
+            offset -= m_len - m_pos;
+        }
+
+        m_pos = m_len = 0;
+    }
+
+    if (m_stream->seek(offset, whence))
+        return true;
+
+    m_lastError = m_stream->lastError();
+    return false;
+}
+
+bool BufferedStream::flush()
+{
+    if (m_writing && !flushWriteBehind())
+        return false;
+
+    if (m_stream->flush())
+        return true;
+
+    m_lastError = m_stream->lastError();
+    return false;
+}
+
+const Error &BufferedStream::lastError() const
+{
+    return m_lastError;
+}
+
+void *BufferedStream::interface(uint32_t id)
+{
+    if (id == interfaceId())
+        return this;
+    else
+        return ExtendsBy<IStream>::interface(id);
+}
+
+size_t BufferedStream::readAhead(size_t size) const
+{
+    if (m_advise == Random)
+        return std::min(m_size, (size + PageSize - 1) & ~static_cast<size_t>(PageSize - 1));
+    else
+        return m_size;
+}
+
+size_t BufferedStream::directRead(char *buffer, size_t size)
+{
+    size_t res = 0;
+    size_t len;
+
+    while (res < size)
+    {
+        len = m_stream->read(buffer + res, size - res);
+
+        if (len == 0)
+        {
+            m_lastError = m_stream->lastError();
+            break;
+        }
+
+        res += len;
+    }
+
+    return res;
+}
+
+bool BufferedStream::directWrite(const char *buffer, size_t size)
+{
+    size_t len;
+
+    while (size > 0)
+    {
+        len = m_stream->write(buffer, size);
+
+        if (len == 0)
+        {
+            m_lastError = m_stream->lastError();
+            return false;
+        }
+
+        buffer += len;
+        size -= len;
+    }
+
+    return true;
+}
+
+bool BufferedStream::dropReadAhead()
+{
+    if (m_pos < m_len && !m_stream->seek(-static_cast<off64_t>(m_len - m_pos), FromCurrent))
+    {
+        m_lastError = m_stream->lastError();
+        return false;
+    }
+
+    m_pos = m_len = 0;
+    return true;
+}
+
+bool BufferedStream::flushWriteBehind()
+{
+    bool res = directWrite(m_buffer, m_len);
+    m_len = 0;
+    return res;
+}
+
+}
@@ -0,0 +1,87 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_BUFFEREDSTREAM_H_
+#define LVFS_BUFFEREDSTREAM_H_
+
+#include <lvfs/IStream>
+
+
+namespace LVFS {
+
+/**
+ * Read-ahead/write-behind buffer on top of any IStream.
+ *
+ * Read-ahead window depends on the advise given for the whole
+ * stream (offset 0, len 0): Random reads are rounded up to a page
+ * only, NoReuse reads bypass the buffer unless they are tiny.
+ * Pending writes are coalesced and go to the original stream on
+ * seek(), flush(), read() or destruction.
+ */
+class PLATFORM_MAKE_PUBLIC BufferedStream : public ExtendsBy<IStream>
+{
+    DECLARE_INTERFACE(LVFS::BufferedStream)
+
+public:
+    enum
+    {
+        PageSize = 4096,
+        DefaultBufferSize = 64 * 1024
+    };
+
+public:
+    BufferedStream(const Interface::Holder &original, size_t bufferSize = DefaultBufferSize);
+    virtual ~BufferedStream();
+
+    inline size_t bufferSize() const { return m_size; }
+
+    /* IStream */
+
+    virtual size_t read(void *buffer, size_t size);
+    virtual size_t write(const void *buffer, size_t size);
+    virtual bool advise(off64_t offset, off64_t len, Advise advise);
+    virtual bool seek(off64_t offset, Whence whence = FromBeginning);
+    virtual bool flush();
+
+    virtual const Error &lastError() const;
+
+protected:
+    virtual void *interface(uint32_t id);
+
+private:
+    size_t readAhead(size_t size) const;
+    size_t directRead(char *buffer, size_t size);
+    bool directWrite(const char *buffer, size_t size);
+    bool dropReadAhead();
+    bool flushWriteBehind();
+
+private:
+    IStream *m_stream;
+    char *m_buffer;
+    size_t m_size;
+    size_t m_pos;
+    size_t m_len;
+    bool m_writing;
+    Advise m_advise;
+    Error m_lastError;
+};
+
+}
+
+#endif /* LVFS_BUFFEREDSTREAM_H_ */
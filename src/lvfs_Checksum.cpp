@@ -0,0 +1,358 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_Checksum.h"
+
+#include "lvfs_BufferPool.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <nmmintrin.h>
+#   define LVFS_CHECKSUM_SSE42 1
+#endif
+
+
+namespace LVFS {
+
+namespace {
+
+    /* Reflected polynomials of CRC-32 (same as LVFS::crc32) and CRC-32C (Castagnoli) */
+    static const uint32_t Crc32Polynomial = 0xEDB88320;
+    static const uint32_t Crc32cPolynomial = 0x82F63B78;
+
+    /* table[0] is the classic one, table[n] is for the byte n positions ahead */
+    template <uint32_t Polynomial>
+    struct SliceBy16Table
+    {
+        SliceBy16Table()
+        {
+            uint32_t crc;
+
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                crc = i;
+
+                for (int j = 0; j < 8; ++j)
+                    crc = (crc >> 1) ^ (Polynomial & (0 - (crc & 1)));
+
+                table[0][i] = crc;
+            }
+
+            for (int n = 1; n < 16; ++n)
+                for (uint32_t i = 0; i < 256; ++i)
+                    table[n][i] = (table[n - 1][i] >> 8) ^ table[0][table[n - 1][i] & 0xFF];
+        }
+
+        uint32_t table[16][256];
+    };
+
+    template <uint32_t Polynomial>
+    uint32_t crcSliceBy16(uint32_t crc, const uint8_t *data, size_t size)
+    {
+        static const SliceBy16Table<Polynomial> slices;
+        const uint32_t (&t)[16][256] = slices.table;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        uint32_t word[4];
+
+        for (; size >= sizeof(word); size -= sizeof(word), data += sizeof(word))
+        {
+            ::memcpy(word, data, sizeof(word));
+            word[0] ^= crc;
+
+            crc = t[15][word[0] & 0xFF] ^ t[14][(word[0] >> 8) & 0xFF] ^ t[13][(word[0] >> 16) & 0xFF] ^ t[12][word[0] >> 24] ^
+                  t[11][word[1] & 0xFF] ^ t[10][(word[1] >> 8) & 0xFF] ^ t[9][(word[1] >> 16) & 0xFF]  ^ t[8][word[1] >> 24]  ^
+                  t[7][word[2] & 0xFF]  ^ t[6][(word[2] >> 8) & 0xFF]  ^ t[5][(word[2] >> 16) & 0xFF]  ^ t[4][word[2] >> 24]  ^
+                  t[3][word[3] & 0xFF]  ^ t[2][(word[3] >> 8) & 0xFF]  ^ t[1][(word[3] >> 16) & 0xFF]  ^ t[0][word[3] >> 24];
+        }
+#endif
+
+        for (; size > 0; --size)
+            crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+
+        return crc;
+    }
+
+#if LVFS_CHECKSUM_SSE42
+    __attribute__((target("sse4.2")))
+    uint32_t crc32cHardware(uint32_t crc, const uint8_t *data, size_t size)
+    {
+        for (; size > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0; --size)
+            crc = _mm_crc32_u8(crc, *data++);
+
+#if defined(__x86_64__)
+        uint64_t crc64 = crc;
+        uint64_t value;
+
+        for (; size >= 8; size -= 8, data += 8)
+        {
+            ::memcpy(&value, data, sizeof(value));
+            crc64 = _mm_crc32_u64(crc64, value);
+        }
+
+        crc = static_cast<uint32_t>(crc64);
+#endif
+        uint32_t value32;
+
+        for (; size >= 4; size -= 4, data += 4)
+        {
+            ::memcpy(&value32, data, sizeof(value32));
+            crc = _mm_crc32_u32(crc, value32);
+        }
+
+        for (; size > 0; --size)
+            crc = _mm_crc32_u8(crc, *data++);
+
+        return crc;
+    }
+
+#endif
+
+    typedef uint32_t (*CrcFunction)(uint32_t crc, const uint8_t *data, size_t size);
+
+    /* Picked once, when the library is loaded */
+    CrcFunction selectCrc32c()
+    {
+#if LVFS_CHECKSUM_SSE42
+        if (__builtin_cpu_supports("sse4.2"))
+            return crc32cHardware;
+#endif
+        return crcSliceBy16<Crc32cPolynomial>;
+    }
+
+    static const CrcFunction s_crc32 = crcSliceBy16<Crc32Polynomial>;
+    static const CrcFunction s_crc32c = selectCrc32c();
+
+
+    static const uint64_t Prime1 = 11400714785074694791ULL;
+    static const uint64_t Prime2 = 14029467366897019727ULL;
+    static const uint64_t Prime3 =  1609587929392839161ULL;
+    static const uint64_t Prime4 =  9650029242287828579ULL;
+    static const uint64_t Prime5 =  2870177450012600261ULL;
+
+    inline uint64_t rotl(uint64_t value, int bits)
+    {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    inline uint64_t read64(const uint8_t *data)
+    {
+        uint64_t res;
+        ::memcpy(&res, data, sizeof(res));
+        return res;
+    }
+
+    inline uint32_t read32(const uint8_t *data)
+    {
+        uint32_t res;
+        ::memcpy(&res, data, sizeof(res));
+        return res;
+    }
+
+    inline uint64_t xxRound(uint64_t acc, uint64_t input)
+    {
+        return rotl(acc + input * Prime2, 31) * Prime1;
+    }
+
+    inline uint64_t xxMerge(uint64_t acc, uint64_t value)
+    {
+        return (acc ^ xxRound(0, value)) * Prime1 + Prime4;
+    }
+
+    uint64_t xxFinalize(uint64_t hash, const uint8_t *data, size_t size)
+    {
+        for (; size >= 8; size -= 8, data += 8)
+            hash = rotl(hash ^ xxRound(0, read64(data)), 27) * Prime1 + Prime4;
+
+        if (size >= 4)
+        {
+            hash = rotl(hash ^ (read32(data) * Prime1), 23) * Prime2 + Prime3;
+            size -= 4;
+            data += 4;
+        }
+
+        for (; size > 0; --size)
+            hash = rotl(hash ^ (*data++ * Prime5), 11) * Prime1;
+
+        hash ^= hash >> 33;
+        hash *= Prime2;
+        hash ^= hash >> 29;
+        hash *= Prime3;
+        hash ^= hash >> 32;
+
+        return hash;
+    }
+
+}
+
+
+Checksum::Checksum(Algorithm algorithm) :
+    m_algorithm(algorithm)
+{
+    reset();
+}
+
+void Checksum::reset()
+{
+    m_crc = 0;
+    m_xx[0] = Prime1 + Prime2;
+    m_xx[1] = Prime2;
+    m_xx[2] = 0;
+    m_xx[3] = 0 - Prime1;
+    m_length = 0;
+    m_buffered = 0;
+}
+
+void Checksum::update(const void *data, size_t size)
+{
+    switch (m_algorithm)
+    {
+        case Crc32:
+            m_crc = crc32(m_crc, data, size);
+            break;
+
+        case Crc32c:
+            m_crc = crc32c(m_crc, data, size);
+            break;
+
+        default:
+            xxUpdate(static_cast<const uint8_t *>(data), size);
+            break;
+    }
+}
+
+bool Checksum::update(IStream &stream, size_t bufferSize)
+{
+    BufferPool::Buffer buffer(bufferSize);
+    size_t read;
+
+    if (UNLIKELY(buffer.data() == NULL))
+        return false;
+
+    while ((read = stream.read(buffer.data(), bufferSize)) > 0)
+        update(buffer.data(), read);
+
+    return stream.lastError().isOk();
+}
+
+uint64_t Checksum::value() const
+{
+    if (m_algorithm != XxHash64)
+        return m_crc;
+
+    uint64_t hash;
+
+    if (m_length >= sizeof(m_buffer))
+    {
+        hash = rotl(m_xx[0], 1) + rotl(m_xx[1], 7) + rotl(m_xx[2], 12) + rotl(m_xx[3], 18);
+        hash = xxMerge(hash, m_xx[0]);
+        hash = xxMerge(hash, m_xx[1]);
+        hash = xxMerge(hash, m_xx[2]);
+        hash = xxMerge(hash, m_xx[3]);
+    }
+    else
+        hash = m_xx[2] + Prime5;
+
+    return xxFinalize(hash + m_length, m_buffer, m_buffered);
+}
+
+uint32_t Checksum::crc32(uint32_t crc, const void *data, size_t size)
+{
+    return s_crc32(crc ^ 0xFFFFFFFF, static_cast<const uint8_t *>(data), size) ^ 0xFFFFFFFF;
+}
+
+uint32_t Checksum::crc32c(uint32_t crc, const void *data, size_t size)
+{
+    return s_crc32c(crc ^ 0xFFFFFFFF, static_cast<const uint8_t *>(data), size) ^ 0xFFFFFFFF;
+}
+
+const char *Checksum::implementation(Algorithm algorithm)
+{
+    switch (algorithm)
+    {
+        case Crc32:
+            return "slice-by-16";
+
+        case Crc32c:
+#if LVFS_CHECKSUM_SSE42
+            if (s_crc32c == crc32cHardware)
+                return "sse4.2";
+#endif
+            return "slice-by-16";
+
+        default:
+            return "scalar";
+    }
+}
+
+uint64_t Checksum::xxHash64(const void *data, size_t size, uint64_t seed)
+{
+    Checksum checksum(XxHash64);
+
+    checksum.m_xx[0] += seed;
+    checksum.m_xx[1] += seed;
+    checksum.m_xx[2] += seed;
+    checksum.m_xx[3] += seed;
+    checksum.update(data, size);
+
+    return checksum.value();
+}
+
+void Checksum::xxUpdate(const uint8_t *data, size_t size)
+{
+    size_t len;
+
+    m_length += size;
+
+    if (m_buffered > 0)
+    {
+        len = std::min(size, sizeof(m_buffer) - m_buffered);
+        ::memcpy(m_buffer + m_buffered, data, len);
+        m_buffered += len;
+        data += len;
+        size -= len;
+
+        if (m_buffered < sizeof(m_buffer))
+            return;
+
+        m_xx[0] = xxRound(m_xx[0], read64(m_buffer));
+        m_xx[1] = xxRound(m_xx[1], read64(m_buffer + 8));
+        m_xx[2] = xxRound(m_xx[2], read64(m_buffer + 16));
+        m_xx[3] = xxRound(m_xx[3], read64(m_buffer + 24));
+        m_buffered = 0;
+    }
+
+    for (; size >= sizeof(m_buffer); size -= sizeof(m_buffer), data += sizeof(m_buffer))
+    {
+        m_xx[0] = xxRound(m_xx[0], read64(data));
+        m_xx[1] = xxRound(m_xx[1], read64(data + 8));
+        m_xx[2] = xxRound(m_xx[2], read64(data + 16));
+        m_xx[3] = xxRound(m_xx[3], read64(data + 24));
+    }
+
+    if (size > 0)
+    {
+        ::memcpy(m_buffer, data, size);
+        m_buffered = size;
+    }
+}
+
+}
@@ -0,0 +1,91 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_CHECKSUM_H_
+#define LVFS_CHECKSUM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <platform/utils.h>
+#include <lvfs/IStream>
+
+
+namespace LVFS {
+
+/**
+ * Incremental checksum of a data stream.
+ *
+ * Unlike LVFS::crc32() from Interface, which is meant for interface
+ * ids computed at compile time, this one is for file data:
+ *  - Crc32 is the same CRC-32 as LVFS::crc32(), slice-by-16;
+ *  - Crc32c uses the SSE4.2 crc32 instruction if the CPU has it,
+ *    slice-by-16 otherwise (chosen once at load time);
+ *  - XxHash64 is xxHash64 with seed 0.
+ *
+ * Static functions take and return finished values, so they can be
+ * chained starting from 0, like zlib's crc32().
+ */
+class PLATFORM_MAKE_PUBLIC Checksum
+{
+public:
+    enum Algorithm
+    {
+        Crc32c,
+        XxHash64,
+        Crc32
+    };
+
+    enum
+    {
+        DefaultBufferSize = 256 * 1024
+    };
+
+public:
+    Checksum(Algorithm algorithm = Crc32c);
+
+    inline Algorithm algorithm() const { return m_algorithm; }
+
+    void reset();
+    void update(const void *data, size_t size);
+    /** Reads the rest of the stream, false on read error. */
+    bool update(IStream &stream, size_t bufferSize = DefaultBufferSize);
+    uint64_t value() const;
+
+    /** Name of the code path selected for this CPU. */
+    static const char *implementation(Algorithm algorithm);
+
+    static uint32_t crc32(uint32_t crc, const void *data, size_t size);
+    static uint32_t crc32c(uint32_t crc, const void *data, size_t size);
+    static uint64_t xxHash64(const void *data, size_t size, uint64_t seed = 0);
+
+private:
+    void xxUpdate(const uint8_t *data, size_t size);
+
+private:
+    Algorithm m_algorithm;
+    uint32_t m_crc;
+    uint64_t m_xx[4];
+    uint64_t m_length;
+    uint8_t m_buffer[32];
+    size_t m_buffered;
+};
+
+}
+
+#endif /* LVFS_CHECKSUM_H_ */
@@ -0,0 +1,342 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_CompactListing.h"
+#include "lvfs_IProperties.h"
+#include "desktop/lvfs_LazyType.h"
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace LVFS {
+
+namespace {
+
+    class Proxy : public Implements<IEntry, IProperties>
+    {
+    public:
+        Proxy(const Interface::Holder &listing, CompactListing::Index index) :
+            m_listing(listing),
+            m_index(index),
+            m_location(NULL),
+            m_type(NULL)
+        {}
+        virtual ~Proxy()
+        {
+            ::free(m_location.load());
+            delete m_type.load();
+        }
+
+        /* IEntry */
+
+        virtual const char *title() const { return listing()->name(m_index); }
+        virtual const char *schema() const { return listing()->schema(); }
+        virtual const char *location() const;
+        virtual const IType *type() const;
+        virtual Interface::Holder open(IStream::Mode mode) const { return listing()->open(location(), mode); }
+
+        /* IProperties */
+
+        virtual off64_t size() const { return listing()->size(m_index); }
+        virtual time_t cTime() const { return listing()->mTime(m_index); }
+        virtual time_t mTime() const { return listing()->mTime(m_index); }
+        virtual time_t aTime() const { return listing()->mTime(m_index); }
+        virtual int permissions() const { return listing()->permissions(m_index); }
+
+    private:
+        inline const CompactListing *listing() const { return m_listing.as<CompactListing>(); }
+
+    private:
+        Interface::Holder m_listing;
+        CompactListing::Index m_index;
+        mutable std::atomic<char *> m_location;
+        mutable std::atomic<LazyType *> m_type;
+    };
+
+    /* Both are built on the first call, by one of the racing threads */
+    const char *Proxy::location() const
+    {
+        char buffer[PATH_MAX];
+        char *expected = NULL;
+        char *res;
+
+        if ((res = m_location) != NULL)
+            return res;
+
+        if (!listing()->path(m_index, buffer, sizeof(buffer)) || (res = ::strdup(buffer)) == NULL)
+            return "";
+
+        if (!m_location.compare_exchange_strong(expected, res))
+        {
+            ::free(res);
+            res = expected;
+        }
+
+        return res;
+    }
+
+    const IType *Proxy::type() const
+    {
+        LazyType *expected = NULL;
+        LazyType *res;
+
+        if ((res = m_type) != NULL)
+            return res;
+
+        if ((res = new (std::nothrow) LazyType(title(), listing()->kind(m_index))) == NULL)
+            return NULL;
+
+        if (!m_type.compare_exchange_strong(expected, res))
+        {
+            delete res;
+            res = expected;
+        }
+
+        return res;
+    }
+
+
+    class Iterator : public IDirectory::const_iterator
+    {
+    public:
+        Iterator(const Interface::Holder &listing, CompactListing::Index index) :
+            const_iterator(new (std::nothrow) Imp(listing, index))
+        {}
+
+    private:
+        class Imp : public Implementation
+        {
+        public:
+            Imp(const Interface::Holder &listing, CompactListing::Index index) :
+                m_listing(listing),
+                m_index(index)
+            {}
+            virtual ~Imp()
+            {}
+
+            virtual bool isEqual(const Holder &other) const { return m_index == other.as<Imp>()->m_index; }
+            virtual reference asReference() const { return current(); }
+            virtual pointer asPointer() const { return &current(); }
+            virtual void next() { ++m_index; m_current.reset(); }
+
+        private:
+            inline const Interface::Holder &current() const
+            {
+                if (!m_current.isValid())
+                    m_current = m_listing.as<CompactListing>()->entry(m_index);
+
+                return m_current;
+            }
+
+        private:
+            Interface::Holder m_listing;
+            CompactListing::Index m_index;
+            mutable Interface::Holder m_current;
+        };
+    };
+
+}
+
+
+CompactListing::CompactListing(const char *schema, const char *location, void *arg, Open open) :
+    m_schema(::strdup(schema)),
+    m_location(::strdup(location)),
+    m_arg(arg),
+    m_open(open),
+    m_count(0),
+    m_capacity(0),
+    m_names(NULL),
+    m_parents(NULL),
+    m_sizes(NULL),
+    m_times(NULL),
+    m_kinds(NULL),
+    m_chunks(NULL),
+    m_chunkCount(0),
+    m_chunkUsed(ChunkSize)
+{}
+
+CompactListing::~CompactListing()
+{
+    for (size_t i = 0; i < m_chunkCount; ++i)
+        ::free(m_chunks[i]);
+
+    ::free(m_chunks);
+    ::free(m_kinds);
+    ::free(m_times);
+    ::free(m_sizes);
+    ::free(m_parents);
+    ::free(m_names);
+    ::free(m_location);
+    ::free(m_schema);
+}
+
+CompactListing::Index CompactListing::add(Index parent, const char *name, unsigned char kind, int permissions, off64_t size, time_t mTime)
+{
+    size_t len = std::strlen(name) + 1;
+    char **chunks;
+
+    if (UNLIKELY(len > ChunkSize || m_count >= Root || (m_count == m_capacity && !grow(m_capacity ? m_capacity * 2 : 1024))))
+        return Root;
+
+    if (m_chunkUsed + len > ChunkSize)
+    {
+        /* Offsets of names are 32 bits */
+        if (UNLIKELY((m_chunkCount + 1) * ChunkSize > UINT32_MAX))
+            return Root;
+
+        if (UNLIKELY((chunks = static_cast<char **>(::realloc(m_chunks, (m_chunkCount + 1) * sizeof(char *)))) == NULL))
+            return Root;
+
+        m_chunks = chunks;
+
+        if (UNLIKELY((m_chunks[m_chunkCount] = static_cast<char *>(::malloc(ChunkSize))) == NULL))
+            return Root;
+
+        ++m_chunkCount;
+        m_chunkUsed = 0;
+    }
+
+    std::memcpy(m_chunks[m_chunkCount - 1] + m_chunkUsed, name, len);
+    m_names[m_count] = (m_chunkCount - 1) * ChunkSize + m_chunkUsed;
+    m_chunkUsed += len;
+
+    m_parents[m_count] = parent;
+    m_sizes[m_count] = size;
+    m_times[m_count] = mTime;
+    m_kinds[m_count] = (kind & 0xF) | (permissions << 4);
+
+    return m_count++;
+}
+
+bool CompactListing::reserve(size_t count)
+{
+    return count <= m_capacity || grow(count);
+}
+
+bool CompactListing::path(Index index, char *buffer, size_t size) const
+{
+    size_t len = std::strlen(m_location);
+    size_t pos = size;
+    size_t nameLen;
+
+    if (index == Root)
+    {
+        if (len >= size)
+            return false;
+
+        std::memcpy(buffer, m_location, len + 1);
+        return true;
+    }
+
+    /* The separator of the first name is there already, as in "/" */
+    if (len > 0 && m_location[len - 1] == '/')
+        --len;
+
+    /* From the entry up to the root, at the end of the buffer */
+    for (Index i = index; i != Root; i = m_parents[i])
+    {
+        nameLen = std::strlen(name(i));
+
+        if (pos < nameLen + 1 + len + 1)
+            return false;
+
+        pos -= nameLen;
+        std::memcpy(buffer + pos, name(i), nameLen);
+        buffer[--pos] = '/';
+    }
+
+    std::memmove(buffer + len, buffer + pos, size - pos);
+    std::memcpy(buffer, m_location, len);
+    buffer[len + size - pos] = 0;
+
+    return true;
+}
+
+Interface::Holder CompactListing::entry(Index index) const
+{
+    return Interface::Holder(new (std::nothrow) Proxy(self(), index));
+}
+
+Interface::Holder CompactListing::open(const char *location, IStream::Mode mode) const
+{
+    if (m_open == NULL)
+    {
+        errno = ENOTSUP;
+        return Interface::Holder();
+    }
+
+    return m_open(m_arg, location, mode);
+}
+
+IDirectory::const_iterator CompactListing::begin() const
+{
+    return Iterator(self(), 0);
+}
+
+IDirectory::const_iterator CompactListing::end() const
+{
+    return Iterator(self(), m_count);
+}
+
+size_t CompactListing::memory() const
+{
+    return sizeof(*this) +
+           m_capacity * (sizeof(*m_names) + sizeof(*m_parents) + sizeof(*m_sizes) + sizeof(*m_times) + sizeof(*m_kinds)) +
+           m_chunkCount * (ChunkSize + sizeof(*m_chunks));
+}
+
+bool CompactListing::grow(size_t capacity)
+{
+    void *res;
+
+    /* Each array is either grown or left as is, so a failure loses nothing */
+    if ((res = ::realloc(m_names, capacity * sizeof(*m_names))) == NULL)
+        return false;
+
+    m_names = static_cast<uint32_t *>(res);
+
+    if ((res = ::realloc(m_parents, capacity * sizeof(*m_parents))) == NULL)
+        return false;
+
+    m_parents = static_cast<Index *>(res);
+
+    if ((res = ::realloc(m_sizes, capacity * sizeof(*m_sizes))) == NULL)
+        return false;
+
+    m_sizes = static_cast<off64_t *>(res);
+
+    if ((res = ::realloc(m_times, capacity * sizeof(*m_times))) == NULL)
+        return false;
+
+    m_times = static_cast<time_t *>(res);
+
+    if ((res = ::realloc(m_kinds, capacity * sizeof(*m_kinds))) == NULL)
+        return false;
+
+    m_kinds = static_cast<unsigned char *>(res);
+    m_capacity = capacity;
+
+    return true;
+}
+
+}
@@ -0,0 +1,123 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_COMPACTLISTING_H_
+#define LVFS_COMPACTLISTING_H_
+
+#include <cstdint>
+#include <sys/types.h>
+#include <lvfs/IDirectory>
+#include <lvfs/IStream>
+
+
+namespace LVFS {
+
+/**
+ * Storage of large listings as a structure of arrays.
+ *
+ * Names are kept in one string blob (of ChunkSize chunks, so pointers
+ * to them stay valid), sizes, modification times and kinds (d_type and
+ * IProperties permissions) in parallel arrays, and paths as a parent
+ * index plus the name. That is 25 bytes per entry plus its name.
+ *
+ * entry() and begin()/end() give IEntry/IProperties proxies created on
+ * demand, their types are LazyType. Proxies keep the listing alive, so
+ * it has to be held by an Interface::Holder. cTime() and aTime() of
+ * proxies are their mTime().
+ *
+ * add() is not thread safe, the rest may be used from any thread when
+ * no add() runs.
+ */
+class PLATFORM_MAKE_PUBLIC CompactListing : public Implements<>
+{
+    PLATFORM_MAKE_NONCOPYABLE(CompactListing)
+    PLATFORM_MAKE_NONMOVEABLE(CompactListing)
+
+public:
+    typedef uint32_t Index;
+    typedef Interface::Holder (*Open)(void *arg, const char *location, IStream::Mode mode);
+
+    enum
+    {
+        ChunkSize = 1024 * 1024
+    };
+
+    /** Parent of the top level entries, also returned on failure. */
+    static const Index Root = UINT32_MAX;
+
+public:
+    /**
+     * Entries are located in \a location of \a schema, proxies are
+     * opened by \a open, if given.
+     */
+    CompactListing(const char *schema, const char *location, void *arg = NULL, Open open = NULL);
+    virtual ~CompactListing();
+
+    Index add(Index parent, const char *name, unsigned char kind, int permissions, off64_t size, time_t mTime);
+    /** Makes room for \a count entries, the arrays grow twice otherwise. */
+    bool reserve(size_t count);
+
+    inline size_t count() const { return m_count; }
+    inline const char *schema() const { return m_schema; }
+    inline const char *location() const { return m_location; }
+
+    inline const char *name(Index index) const { return m_chunks[m_names[index] / ChunkSize] + m_names[index] % ChunkSize; }
+    inline Index parent(Index index) const { return m_parents[index]; }
+    inline off64_t size(Index index) const { return m_sizes[index]; }
+    inline time_t mTime(Index index) const { return m_times[index]; }
+    inline unsigned char kind(Index index) const { return m_kinds[index] & 0xF; }
+    inline int permissions(Index index) const { return m_kinds[index] >> 4; }
+
+    /** Full location of the entry, false if it doesn't fit. */
+    bool path(Index index, char *buffer, size_t size) const;
+
+    Interface::Holder entry(Index index) const;
+    Interface::Holder open(const char *location, IStream::Mode mode) const;
+
+    IDirectory::const_iterator begin() const;
+    IDirectory::const_iterator end() const;
+
+    /** Bytes taken by the storage. */
+    size_t memory() const;
+
+private:
+    bool grow(size_t capacity);
+
+private:
+    char *m_schema;
+    char *m_location;
+    void *m_arg;
+    Open m_open;
+
+    size_t m_count;
+    size_t m_capacity;
+    uint32_t *m_names;
+    Index *m_parents;
+    off64_t *m_sizes;
+    time_t *m_times;
+    unsigned char *m_kinds;
+
+    char **m_chunks;
+    size_t m_chunkCount;
+    size_t m_chunkUsed;
+};
+
+}
+
+#endif /* LVFS_COMPACTLISTING_H_ */
@@ -0,0 +1,317 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_DescriptorCache.h"
+#include "lvfs_IEntry.h"
+#include "lvfs_PathCache.h"
+
+#include <efc/List>
+#include <efc/Map>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+
+namespace LVFS {
+
+namespace {
+
+    typedef IIdentity::Key Key;
+
+    struct Record
+    {
+        int descriptor;
+        int users;
+        bool stale;
+        uint32_t generation;
+        ::EFC::List<Key>::iterator idle;
+    };
+
+    static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+    static ::EFC::Map<Key, Record> s_records;
+    static ::EFC::Map<int, Key> s_descriptors;
+    static ::EFC::List<Key> s_idle;
+    static size_t s_limit = 0;
+    static size_t s_hits = 0;
+    static size_t s_misses = 0;
+
+
+    inline size_t defaultLimit()
+    {
+        struct rlimit limit;
+
+        if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur / 4 < DescriptorCache::DefaultLimit)
+            return limit.rlim_cur / 4;
+
+        return DescriptorCache::DefaultLimit;
+    }
+
+    inline void close(::EFC::Map<Key, Record>::iterator record)
+    {
+        ::close((*record).second.descriptor);
+        s_descriptors.erase((*record).second.descriptor);
+        s_records.erase(record);
+    }
+
+    /*
+     * Records are found by device and inode only: stat() can't tell the
+     * generation, so entries may or may not know it. Where it is known,
+     * it is compared with the one of the descriptor.
+     */
+    inline Key index(const Key &key)
+    {
+        Key res = { key.device, key.inode, 0 };
+        return res;
+    }
+
+    inline bool matches(const Key &key, uint32_t generation)
+    {
+        return key.generation == 0 || key.generation == generation;
+    }
+
+    /* Closes it now if it is idle, once released otherwise */
+    inline void drop(::EFC::Map<Key, Record>::iterator record)
+    {
+        if ((*record).second.users == 0)
+        {
+            s_idle.erase((*record).second.idle);
+            close(record);
+        }
+        else
+            (*record).second.stale = true;
+    }
+
+    /* Closes idle ones until "size" more fit into the limit */
+    void shrink(size_t size)
+    {
+        while (!s_idle.empty() && s_records.size() + size > s_limit)
+        {
+            auto i = s_records.find(s_idle.front());
+            s_idle.pop_front();
+            close(i);
+        }
+    }
+
+    bool identify(const Interface::Holder &entry, Key &key)
+    {
+        const IEntry *file = entry->as<IEntry>();
+        struct stat st;
+
+        if (const IIdentity *identity = entry->as<IIdentity>())
+        {
+            key = identity->key();
+            return true;
+        }
+
+        if (file == NULL || ::stat(file->location(), &st) != 0)
+            return false;
+
+        key.device = st.st_dev;
+        key.inode = st.st_ino;
+        key.generation = 0;
+
+        return true;
+    }
+
+}
+
+
+DescriptorCache::Descriptor::Descriptor(const Interface::Holder &entry) :
+    m_descriptor(acquire(entry))
+{}
+
+DescriptorCache::Descriptor::~Descriptor()
+{
+    if (m_descriptor >= 0)
+        release(m_descriptor);
+}
+
+int DescriptorCache::acquire(const Interface::Holder &entry)
+{
+    const IEntry *file = entry->as<IEntry>();
+    Key opened;
+    Key key;
+    int fd;
+
+    if (file == NULL || std::strcmp(file->schema(), "file") != 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (!identify(entry, key))
+        return -1;
+
+    ::pthread_mutex_lock(&s_mutex);
+    auto i = s_records.find(index(key));
+
+    /* The inode may have been reused by another file */
+    if (i != s_records.end() && !(*i).second.stale && !matches(key, (*i).second.generation))
+        drop(i);
+    else if (i != s_records.end() && !(*i).second.stale)
+    {
+        if ((*i).second.users++ == 0)
+            s_idle.erase((*i).second.idle);
+
+        ++s_hits;
+        fd = (*i).second.descriptor;
+        ::pthread_mutex_unlock(&s_mutex);
+        return fd;
+    }
+
+    ++s_misses;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    if ((fd = PathCache::open(file->location(), O_RDONLY | O_CLOEXEC)) == -1)
+        return -1;
+
+    /* The location may have got another file meanwhile */
+    if (!IIdentity::key(fd, opened) ||
+        opened.device != key.device || opened.inode != key.inode || !matches(key, opened.generation))
+    {
+        ::close(fd);
+        errno = ESTALE;
+        return -1;
+    }
+
+    ::pthread_mutex_lock(&s_mutex);
+
+    if (s_limit == 0)
+        s_limit = defaultLimit();
+
+    shrink(1);
+
+    /* Another thread may have cached one meanwhile, this one stays private */
+    if (s_records.size() < s_limit && s_records.find(index(key)) == s_records.end())
+    {
+        Record record = { fd, 1, false, opened.generation, s_idle.end() };
+        s_records[index(key)] = record;
+        s_descriptors[fd] = index(key);
+    }
+
+    ::pthread_mutex_unlock(&s_mutex);
+    return fd;
+}
+
+void DescriptorCache::release(int descriptor)
+{
+    ::pthread_mutex_lock(&s_mutex);
+    auto i = s_descriptors.find(descriptor);
+
+    if (i == s_descriptors.end())
+        ::close(descriptor);
+    else
+    {
+        auto record = s_records.find((*i).second);
+
+        if (--(*record).second.users == 0)
+            if ((*record).second.stale || s_records.size() > s_limit)
+                close(record);
+            else
+            {
+                s_idle.push_back((*record).first);
+                (*record).second.idle = --s_idle.end();
+            }
+    }
+
+    ::pthread_mutex_unlock(&s_mutex);
+}
+
+void DescriptorCache::invalidate(const IIdentity::Key &key)
+{
+    ::pthread_mutex_lock(&s_mutex);
+    auto i = s_records.find(index(key));
+
+    if (i != s_records.end() && matches(key, (*i).second.generation))
+        drop(i);
+
+    ::pthread_mutex_unlock(&s_mutex);
+}
+
+void DescriptorCache::clear()
+{
+    ::pthread_mutex_lock(&s_mutex);
+
+    while (!s_idle.empty())
+    {
+        auto i = s_records.find(s_idle.front());
+        s_idle.pop_front();
+        close(i);
+    }
+
+    for (auto &i : s_records)
+        i.second.stale = true;
+
+    ::pthread_mutex_unlock(&s_mutex);
+}
+
+size_t DescriptorCache::limit()
+{
+    ::pthread_mutex_lock(&s_mutex);
+
+    if (s_limit == 0)
+        s_limit = defaultLimit();
+
+    size_t res = s_limit;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return res;
+}
+
+void DescriptorCache::setLimit(size_t limit)
+{
+    ::pthread_mutex_lock(&s_mutex);
+    s_limit = limit > 0 ? limit : defaultLimit();
+    shrink(0);
+    ::pthread_mutex_unlock(&s_mutex);
+}
+
+size_t DescriptorCache::open()
+{
+    ::pthread_mutex_lock(&s_mutex);
+    size_t res = s_records.size();
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return res;
+}
+
+size_t DescriptorCache::hits()
+{
+    ::pthread_mutex_lock(&s_mutex);
+    size_t res = s_hits;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return res;
+}
+
+size_t DescriptorCache::misses()
+{
+    ::pthread_mutex_lock(&s_mutex);
+    size_t res = s_misses;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return res;
+}
+
+}
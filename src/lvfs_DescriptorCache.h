@@ -0,0 +1,90 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_DESCRIPTORCACHE_H_
+#define LVFS_DESCRIPTORCACHE_H_
+
+#include <lvfs/IIdentity>
+
+
+namespace LVFS {
+
+/**
+ * Process-wide cache of read-only descriptors of local files.
+ *
+ * acquire() of entries of one file (same IIdentity::Key) returns one
+ * shared descriptor, so its offset means nothing: use pread() and
+ * friends. Entries without IIdentity are stat()ed for the key, which
+ * has no generation then; where the key has one, it must match the
+ * one of the open descriptor.
+ * Files are opened through the PathCache.
+ *
+ * Released descriptors stay open for reuse, the least recently used
+ * ones are closed when more than limit() are open. The default limit
+ * is a quarter of RLIMIT_NOFILE, at most DefaultLimit. Descriptors
+ * in use are never closed, if they are all in use the new one is not
+ * cached.
+ */
+class PLATFORM_MAKE_PUBLIC DescriptorCache
+{
+public:
+    enum
+    {
+        DefaultLimit = 256
+    };
+
+    /**
+     * Descriptor held for the lifetime of the object,
+     * descriptor() is -1 on failure and errno tells why.
+     */
+    class PLATFORM_MAKE_PUBLIC Descriptor
+    {
+        PLATFORM_MAKE_NONCOPYABLE(Descriptor)
+        PLATFORM_MAKE_NONMOVEABLE(Descriptor)
+
+    public:
+        Descriptor(const Interface::Holder &entry);
+        ~Descriptor();
+
+        inline int descriptor() const { return m_descriptor; }
+
+    private:
+        int m_descriptor;
+    };
+
+public:
+    static int acquire(const Interface::Holder &entry);
+    static void release(int descriptor);
+
+    /** Closes the descriptor of the file as soon as it is released. */
+    static void invalidate(const IIdentity::Key &key);
+    static void clear();
+
+    static size_t limit();
+    static void setLimit(size_t limit);
+
+    /** Descriptors open, in use or not. */
+    static size_t open();
+    static size_t hits();
+    static size_t misses();
+};
+
+}
+
+#endif /* LVFS_DESCRIPTORCACHE_H_ */
@@ -0,0 +1,460 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_Duplicates.h"
+#include "lvfs_Checksum.h"
+#include "lvfs_BufferPool.h"
+
+#include <lvfs/IEntry>
+#include <lvfs/IStream>
+#include <lvfs/IDirectory>
+#include <lvfs/IProperties>
+
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+
+namespace LVFS {
+
+namespace {
+
+    enum { CompareSize = 64 * 1024 };
+
+    size_t readFully(IStream *stream, void *buffer, size_t size)
+    {
+        size_t res = 0;
+
+        for (size_t read; res < size; res += read)
+            if ((read = stream->read(static_cast<char *>(buffer) + res, size - res)) == 0)
+                break;
+
+        return res;
+    }
+
+    /* Equal hashes are not equal contents, this is what tells */
+    bool same(const Interface::Holder &file1, const Interface::Holder &file2)
+    {
+        BufferPool::Buffer buffer(2 * CompareSize);
+        Interface::Holder stream1;
+        Interface::Holder stream2;
+        IStream *in1;
+        IStream *in2;
+        size_t read1;
+        size_t read2;
+
+        if (UNLIKELY(buffer.data() == NULL))
+            return false;
+
+        if (!(stream1 = file1->as<IEntry>()->open(IStream::Read)).isValid() ||
+            !(stream2 = file2->as<IEntry>()->open(IStream::Read)).isValid())
+            return false;
+
+        in1 = stream1->as<IStream>();
+        in2 = stream2->as<IStream>();
+        in1->advise(0, 0, IStream::Sequential);
+        in2->advise(0, 0, IStream::Sequential);
+
+        do
+        {
+            read1 = readFully(in1, buffer.data(), CompareSize);
+            read2 = readFully(in2, buffer.data() + CompareSize, CompareSize);
+
+            if (read1 != read2 || ::memcmp(buffer.data(), buffer.data() + CompareSize, read1) != 0)
+                return false;
+        }
+        while (read1 == CompareSize);
+
+        return true;
+    }
+
+}
+
+
+Duplicates::Duplicates(const Entries &roots, void *arg, Callback callback, int workers) :
+    m_roots(roots),
+    m_arg(arg),
+    m_callback(callback),
+    m_workers(workers),
+    m_cancelled(false),
+    m_running(0),
+    m_busy(0)
+{
+    ::pthread_mutex_init(&m_mutex, NULL);
+    ::pthread_cond_init(&m_changed, NULL);
+}
+
+Duplicates::~Duplicates()
+{
+    ::pthread_cond_destroy(&m_changed);
+    ::pthread_mutex_destroy(&m_mutex);
+}
+
+bool Duplicates::run()
+{
+    for (auto i : m_roots)
+        add(i);
+
+    spawn(scanWorker);
+
+    if (!m_cancelled)
+    {
+        m_next = m_sizes.begin();
+        spawn(hashWorker);
+    }
+
+    if (m_lastError.isOk() && m_cancelled)
+        m_lastError = Error(ECANCELED);
+
+    return m_lastError.isOk();
+}
+
+void Duplicates::spawn(void *(*worker)(void *))
+{
+    pthread_t *threads = new (std::nothrow) pthread_t [m_workers];
+    int started = 0;
+
+    if (LIKELY(threads != NULL))
+    {
+        Locker lock(m_mutex);
+
+        for (; started < m_workers; ++started)
+            if (::pthread_create(&threads[started], NULL, worker, this) != 0)
+                break;
+
+        m_running = started;
+
+        /* Groups are passed to the callback from here only */
+        while (m_running > 0)
+        {
+            ::pthread_cond_wait(&m_changed, &m_mutex);
+
+            ::pthread_mutex_unlock(&m_mutex);
+            deliver();
+            ::pthread_mutex_lock(&m_mutex);
+        }
+    }
+
+    for (int i = 0; i < started; ++i)
+        ::pthread_join(threads[i], NULL);
+
+    delete [] threads;
+
+    if (started == 0)
+    {
+        m_running = 1;
+        worker(this);
+    }
+
+    deliver();
+}
+
+void Duplicates::finished()
+{
+    Locker lock(m_mutex);
+
+    if (--m_running == 0)
+        ::pthread_cond_broadcast(&m_changed);
+}
+
+void Duplicates::deliver()
+{
+    Entries group;
+
+    for (;;)
+    {
+        {
+            Locker lock(m_mutex);
+
+            if (m_results.empty())
+                break;
+
+            group = m_results.front();
+            m_results.pop_front();
+        }
+
+        if (!m_cancelled)
+            m_callback(m_arg, group);
+    }
+}
+
+void *Duplicates::scanWorker(void *duplicates)
+{
+    Duplicates *self = static_cast<Duplicates *>(duplicates);
+    Interface::Holder directory;
+    File *file;
+
+    for (;;)
+    {
+        {
+            Locker lock(self->m_mutex);
+
+            while (self->m_pending.empty() && self->m_queue.empty() && self->m_busy > 0 && !self->m_cancelled)
+                ::pthread_cond_wait(&self->m_changed, &self->m_mutex);
+
+            if ((self->m_pending.empty() && self->m_queue.empty()) || self->m_cancelled)
+                break;
+
+            /* Directories first, they keep the other threads busy */
+            if (!self->m_pending.empty())
+            {
+                directory = self->m_pending.front();
+                self->m_pending.pop_front();
+                file = NULL;
+            }
+            else
+            {
+                file = self->m_queue.front();
+                self->m_queue.pop_front();
+            }
+
+            ++self->m_busy;
+        }
+
+        if (file == NULL)
+            self->scan(directory);
+        else
+            self->partialHash(*file);
+
+        Locker lock(self->m_mutex);
+        --self->m_busy;
+        ::pthread_cond_broadcast(&self->m_changed);
+    }
+
+    self->finished();
+    return NULL;
+}
+
+void *Duplicates::hashWorker(void *duplicates)
+{
+    Duplicates *self = static_cast<Duplicates *>(duplicates);
+    Sizes::iterator group;
+
+    for (;;)
+    {
+        {
+            Locker lock(self->m_mutex);
+
+            while (self->m_next != self->m_sizes.end() && (*self->m_next).second.size() < 2)
+                ++self->m_next;
+
+            if (self->m_next == self->m_sizes.end() || self->m_cancelled)
+                break;
+
+            group = self->m_next;
+            ++self->m_next;
+        }
+
+        self->process((*group).first, (*group).second);
+    }
+
+    self->finished();
+    return NULL;
+}
+
+void Duplicates::add(const Interface::Holder &entry)
+{
+    File file = { entry, 0, 0, Queued };
+
+    if (entry->as<IDirectory>())
+    {
+        Locker lock(m_mutex);
+        m_pending.push_back(entry);
+        ::pthread_cond_broadcast(&m_changed);
+    }
+    else if (const IProperties *props = entry->as<IProperties>())
+        /* Empty files are all equal, nothing to report */
+        if ((file.size = props->size()) > 0)
+        {
+            const IIdentity *identity = entry->as<IIdentity>();
+            Locker lock(m_mutex);
+
+            /* Hardlinks have the same contents, only the first one counts */
+            if (identity != NULL && identity->links() > 1)
+            {
+                bool &seen = m_links[identity->key()];
+
+                if (seen)
+                    return;
+
+                seen = true;
+            }
+
+            Files &files = m_sizes[file.size];
+            files.push_back(file);
+
+            /* Only sizes with a second file are worth hashing */
+            if (files.size() == 2)
+                for (auto &i : files)
+                    m_queue.push_back(&i);
+            else if (files.size() > 2)
+                m_queue.push_back(&files.back());
+            else
+                return;
+
+            ::pthread_cond_broadcast(&m_changed);
+        }
+}
+
+void Duplicates::scan(const Interface::Holder &directory)
+{
+    const IDirectory *dir = directory->as<IDirectory>();
+
+    for (auto i = dir->begin(), end = dir->end(); i != end && !m_cancelled; ++i)
+        add(*i);
+}
+
+void Duplicates::process(off64_t size, Files &files)
+{
+    ::EFC::Map<uint64_t, Files> partial;
+    ::EFC::Map<uint64_t, Files> full;
+
+    for (auto &i : files)
+    {
+        if (m_cancelled)
+            return;
+
+        if (i.state == Queued)
+            partialHash(i);
+
+        if (i.state == Hashed)
+            partial[i.hash].push_back(i);
+    }
+
+    for (auto &i : partial)
+        if (i.second.size() < 2)
+            continue;
+        else if (size <= 2 * PartialSize)
+            /* Partial hash already covers the whole file */
+            confirm(i.second);
+        else
+        {
+            full.clear();
+
+            for (auto &j : i.second)
+                if (m_cancelled)
+                    return;
+                else if (fullHash(j))
+                    full[j.hash].push_back(j);
+
+            for (auto &j : full)
+                if (j.second.size() >= 2)
+                    confirm(j.second);
+        }
+}
+
+void Duplicates::confirm(Files &files)
+{
+    Files group;
+
+    /* Splits files into classes of equal contents, the first file of the rest stands for the next one */
+    while (files.size() >= 2 && !m_cancelled)
+    {
+        group.clear();
+        group.push_back(files.front());
+        files.pop_front();
+
+        for (auto i = files.begin(); i != files.end() && !m_cancelled;)
+            if (same(group.front().entry, (*i).entry))
+            {
+                group.push_back(*i);
+                auto j = i++;
+                files.erase(j);
+            }
+            else
+                ++i;
+
+        if (group.size() >= 2 && !m_cancelled)
+            found(group);
+    }
+}
+
+void Duplicates::found(const Files &files)
+{
+    Entries group;
+
+    for (auto &i : files)
+        group.push_back(i.entry);
+
+    Locker lock(m_mutex);
+    m_results.push_back(group);
+    ::pthread_cond_broadcast(&m_changed);
+}
+
+void Duplicates::partialHash(File &file)
+{
+    const IEntry *entry = file.entry->as<IEntry>();
+    Checksum checksum(Checksum::XxHash64);
+    Interface::Holder stream;
+    IStream *in;
+    char buffer[PartialSize];
+    off64_t tail;
+    size_t read;
+
+    file.state = Unreadable;
+
+    if (!(stream = entry->open(IStream::Read)).isValid())
+        return;
+
+    in = stream->as<IStream>();
+    in->advise(0, 0, IStream::Random);
+
+    read = std::min<off64_t>(file.size, PartialSize);
+
+    if (readFully(in, buffer, read) != read)
+        return;
+
+    checksum.update(buffer, read);
+
+    if (file.size > PartialSize)
+    {
+        tail = std::max<off64_t>(file.size - PartialSize, PartialSize);
+        read = file.size - tail;
+
+        if (!in->seek(tail) || readFully(in, buffer, read) != read)
+            return;
+
+        checksum.update(buffer, read);
+    }
+
+    file.hash = checksum.value();
+    file.state = Hashed;
+}
+
+bool Duplicates::fullHash(File &file)
+{
+    const IEntry *entry = file.entry->as<IEntry>();
+    Checksum checksum(Checksum::XxHash64);
+    Interface::Holder stream;
+    IStream *in;
+
+    if (!(stream = entry->open(IStream::Read)).isValid())
+        return false;
+
+    in = stream->as<IStream>();
+    in->advise(0, 0, IStream::Sequential);
+
+    if (!checksum.update(*in))
+        return false;
+
+    file.hash = checksum.value();
+    return true;
+}
+
+}
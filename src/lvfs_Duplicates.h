@@ -0,0 +1,150 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_DUPLICATES_H_
+#define LVFS_DUPLICATES_H_
+
+#include <sys/types.h>
+#include <cstdint>
+#include <pthread.h>
+#include <efc/List>
+#include <efc/Map>
+#include <lvfs/Interface>
+#include <lvfs/IIdentity>
+#include <lvfs/Error>
+
+
+namespace LVFS {
+
+/**
+ * Finds files with identical contents in IDirectory trees.
+ *
+ * run() walks the trees with several threads and groups files by
+ * IProperties::size(). Files of equal size are compared by xxHash64
+ * of their first and last PartialSize bytes, and only files whose
+ * partial hashes collide are hashed completely. Files left with equal
+ * hashes are compared byte by byte before they are reported. Hardlinks
+ * (equal IIdentity::key() of entries with more than one link) are
+ * counted once, files which can't be read are skipped.
+ *
+ * Partial hashes are taken by the same threads while the trees are
+ * still scanned, as soon as a second file of a size turns up. A size
+ * is complete only once the scan is over, then the sizes are finished
+ * one by one and every group of identical files is passed to the
+ * callback as soon as it is confirmed, from the thread which called
+ * run().
+ */
+class PLATFORM_MAKE_PUBLIC Duplicates
+{
+    PLATFORM_MAKE_NONCOPYABLE(Duplicates)
+    PLATFORM_MAKE_NONMOVEABLE(Duplicates)
+
+public:
+    typedef ::EFC::List<Interface::Holder> Entries;
+    typedef void (*Callback)(void *arg, const Entries &group);
+
+    enum
+    {
+        DefaultWorkers = 4,
+        PartialSize = 4096
+    };
+
+public:
+    Duplicates(const Entries &roots, void *arg, Callback callback, int workers = DefaultWorkers);
+    ~Duplicates();
+
+    bool run();
+    inline void cancel() { m_cancelled = true; }
+
+    const Error &lastError() const { return m_lastError; }
+
+private:
+    enum State
+    {
+        Queued,
+        Hashed,
+        Unreadable
+    };
+
+    struct File
+    {
+        Interface::Holder entry;
+        off64_t size;
+        uint64_t hash;
+        State state;
+    };
+
+    typedef ::EFC::List<File> Files;
+    typedef ::EFC::Map<off64_t, Files> Sizes;
+
+    class Locker
+    {
+    public:
+        Locker(pthread_mutex_t &mutex) :
+            m_mutex(mutex)
+        {
+            ::pthread_mutex_lock(&m_mutex);
+        }
+        ~Locker()
+        {
+            ::pthread_mutex_unlock(&m_mutex);
+        }
+
+    private:
+        pthread_mutex_t &m_mutex;
+    };
+
+private:
+    void spawn(void *(*worker)(void *));
+    void finished();
+    void deliver();
+    static void *scanWorker(void *self);
+    static void *hashWorker(void *self);
+
+    void add(const Interface::Holder &entry);
+    void scan(const Interface::Holder &directory);
+    void process(off64_t size, Files &files);
+    void confirm(Files &files);
+    void found(const Files &files);
+    void partialHash(File &file);
+    bool fullHash(File &file);
+
+private:
+    Entries m_roots;
+    void *m_arg;
+    Callback m_callback;
+    int m_workers;
+    volatile bool m_cancelled;
+    Error m_lastError;
+
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_changed;
+    int m_running;
+    int m_busy;
+    Entries m_pending;
+    ::EFC::List<File *> m_queue;
+    ::EFC::Map<IIdentity::Key, bool> m_links;
+    Sizes m_sizes;
+    Sizes::iterator m_next;
+    ::EFC::List<Entries> m_results;
+};
+
+}
+
+#endif /* LVFS_DUPLICATES_H_ */
@@ -37,6 +37,9 @@ Error::~Error()
 
 const char *Error::description() const
 {
+    if (m_code == ChecksumMismatch)
+        return "Checksum mismatch";
+
     return ::strerror(m_code);
 }
 
@@ -27,6 +27,13 @@ namespace LVFS {
 
 class PLATFORM_MAKE_PUBLIC Error
 {
+public:
+    enum
+    {
+        /** Data read back differs from the data written */
+        ChecksumMismatch = -1
+    };
+
 public:
     Error();
     Error(int code);
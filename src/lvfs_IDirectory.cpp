@@ -19,9 +19,104 @@
 
 #include "lvfs_IDirectory.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
 
 namespace LVFS {
 
+namespace {
+
+    struct Name
+    {
+        const char *name;
+        size_t index;
+
+        inline bool operator<(const Name &other) const
+        {
+            int res = std::strcmp(name, other.name);
+            return res < 0 || (res == 0 && index < other.index);
+        }
+    };
+
+    inline bool isValid(const char *name)
+    {
+        return name != NULL && name[0] != 0 && std::strchr(name, '/') == NULL &&
+               std::strcmp(name, ".") != 0 && std::strcmp(name, "..") != 0;
+    }
+
+    inline const Name *find(const Name *begin, const Name *end, const char *name)
+    {
+        const Name key = { name, 0 };
+        const Name *res = std::lower_bound(begin, end, key);
+        return res != end && std::strcmp(res->name, name) == 0 ? res : end;
+    }
+
+    /* Sorted titles of the current entries, the entries are held while the titles are borrowed */
+    class Snapshot
+    {
+        PLATFORM_MAKE_NONCOPYABLE(Snapshot)
+        PLATFORM_MAKE_NONMOVEABLE(Snapshot)
+
+    public:
+        Snapshot(const IDirectory *directory) :
+            m_names(NULL),
+            m_count(0)
+        {
+            for (auto i = directory->begin(), end = directory->end(); i != end; ++i)
+                if ((*i)->as<IEntry>() != NULL)
+                    m_entries.push_back(*i);
+
+            if (UNLIKELY((m_names = new (std::nothrow) Name [m_entries.size() + 1]) == NULL))
+                return;
+
+            for (auto &i : m_entries)
+            {
+                m_names[m_count].name = i->as<IEntry>()->title();
+                m_names[m_count].index = m_count;
+                ++m_count;
+            }
+
+            std::sort(m_names, m_names + m_count);
+        }
+
+        ~Snapshot()
+        {
+            delete [] m_names;
+        }
+
+        inline bool isValid() const { return m_names != NULL; }
+        inline bool contains(const char *name) const { return find(m_names, m_names + m_count, name) != m_names + m_count; }
+
+    private:
+        EFC::List<Interface::Holder> m_entries;
+        Name *m_names;
+        size_t m_count;
+    };
+
+    template <typename T>
+    bool fail(T *items, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+            items[i].result = Error(ENOMEM);
+
+        return false;
+    }
+
+    /* Names given twice fail except for their first item */
+    template <typename T>
+    void unique(T *items, Name *names, size_t count)
+    {
+        std::sort(names, names + count);
+
+        for (size_t i = 1; i < count; ++i)
+            if (std::strcmp(names[i].name, names[i - 1].name) == 0)
+                items[names[i].index].result = Error(EEXIST);
+    }
+
+}
+
 IDirectory::const_iterator::Implementation::Implementation()
 {}
 
@@ -31,4 +126,127 @@ IDirectory::const_iterator::Implementation::~Implementation()
 IDirectory::~IDirectory()
 {}
 
+bool IDirectory::renameAll(Rename *items, size_t count)
+{
+    bool res = check(items, count);
+
+    for (size_t i = 0; i < count; ++i)
+        if (items[i].result.isOk() && !rename(items[i].file, items[i].name))
+        {
+            items[i].result = lastError();
+            res = false;
+        }
+
+    return res;
+}
+
+bool IDirectory::createAll(Create *items, size_t count)
+{
+    bool res = check(items, count);
+
+    for (size_t i = 0; i < count; ++i)
+        if (items[i].result.isOk() && !(items[i].entry = entry(items[i].name, items[i].type, true)).isValid())
+        {
+            items[i].result = lastError();
+            res = false;
+        }
+
+    return res;
+}
+
+bool IDirectory::check(Rename *items, size_t count) const
+{
+    const IEntry *entry;
+    const Name *name;
+    size_t valid = 0;
+    Name *sources;
+    Name *targets;
+    bool res = true;
+
+    const Snapshot existing(this);
+    sources = new (std::nothrow) Name [count + 1];
+    targets = new (std::nothrow) Name [count + 1];
+
+    if (UNLIKELY(!existing.isValid() || sources == NULL || targets == NULL))
+    {
+        delete [] targets;
+        delete [] sources;
+        return fail(items, count);
+    }
+
+    for (size_t i = 0; i < count; ++i)
+        if (!isValid(items[i].name) || !items[i].file.isValid() || (entry = items[i].file->as<IEntry>()) == NULL)
+            items[i].result = Error(EINVAL);
+        else
+        {
+            items[i].result = Error();
+            sources[valid].name = entry->title();
+            sources[valid].index = i;
+            targets[valid].name = items[i].name;
+            targets[valid++].index = i;
+        }
+
+    unique(items, targets, valid);
+    std::sort(sources, sources + valid);
+
+    for (size_t i = 0; i < count; ++i)
+        if (items[i].result.isOk() && existing.contains(items[i].name))
+        {
+            /* Unless an earlier item which is still Ok frees it, items are checked in order */
+            for (name = find(sources, sources + valid, items[i].name);
+                 name != sources + valid && name->index < i && std::strcmp(name->name, items[i].name) == 0;
+                 ++name)
+                if (items[name->index].result.isOk())
+                    break;
+
+            if (name == sources + valid || name->index >= i || std::strcmp(name->name, items[i].name) != 0)
+                items[i].result = Error(EEXIST);
+        }
+
+    delete [] targets;
+    delete [] sources;
+
+    for (size_t i = 0; i < count; ++i)
+        res = res && items[i].result.isOk();
+
+    return res;
+}
+
+bool IDirectory::check(Create *items, size_t count) const
+{
+    size_t named = 0;
+    Name *targets;
+    bool res = true;
+
+    const Snapshot existing(this);
+    targets = new (std::nothrow) Name [count + 1];
+
+    if (UNLIKELY(!existing.isValid() || targets == NULL))
+    {
+        delete [] targets;
+        return fail(items, count);
+    }
+
+    for (size_t i = 0; i < count; ++i)
+        if (!isValid(items[i].name))
+            items[i].result = Error(EINVAL);
+        else if (existing.contains(items[i].name))
+            items[i].result = Error(EEXIST);
+        else
+        {
+            items[i].result = Error();
+            targets[named].name = items[i].name;
+            targets[named++].index = i;
+        }
+
+    unique(items, targets, named);
+
+    delete [] targets;
+
+    for (size_t i = 0; i < count; ++i)
+        res = res && items[i].result.isOk();
+
+    return res;
+}
+
 }
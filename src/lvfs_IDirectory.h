@@ -96,6 +96,27 @@ public:
         const volatile bool &aborted;
     };
 
+    /**
+     * An item of renameAll(), \a result tells how it went.
+     */
+    struct Rename
+    {
+        Interface::Holder file;
+        const char *name;
+        Error result;
+    };
+
+    /**
+     * An item of createAll(), \a entry is the created one, if any.
+     */
+    struct Create
+    {
+        const char *name;
+        const IType *type;
+        Interface::Holder entry;
+        Error result;
+    };
+
 public:
     virtual ~IDirectory();
 
@@ -109,7 +130,27 @@ public:
     virtual bool rename(const Interface::Holder &file, const char *name) = 0;
     virtual bool remove(const Interface::Holder &file) = 0;
 
+    /**
+     * Batch variants of rename() and entry(name, type, true).
+     *
+     * All names are checked at once against one snapshot of the
+     * directory and against each other: invalid ones fail with EINVAL,
+     * taken ones with EEXIST, unless an earlier rename of the batch
+     * frees them. The other items are done in order. Return true if
+     * all items succeeded, each item has its own result.
+     *
+     * By default items are done by rename() and entry(). Directories
+     * of local files may override these to do them by renameat2() and
+     * mkdirat() on a descriptor of the directory instead.
+     */
+    virtual bool renameAll(Rename *items, size_t count);
+    virtual bool createAll(Create *items, size_t count);
+
     virtual const Error &lastError() const = 0;
+
+protected:
+    bool check(Rename *items, size_t count) const;
+    bool check(Create *items, size_t count) const;
 };
 
 
@@ -0,0 +1,99 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_IExtendedProperties.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+
+namespace LVFS {
+
+namespace {
+
+    struct Field
+    {
+        int field;
+        unsigned int mask;
+    };
+
+    static const Field s_fields[] =
+    {
+        { IExtendedProperties::Type,   STATX_TYPE },
+        { IExtendedProperties::Mode,   STATX_MODE },
+        { IExtendedProperties::Links,  STATX_NLINK },
+        { IExtendedProperties::Owner,  STATX_UID | STATX_GID },
+        { IExtendedProperties::ATime,  STATX_ATIME },
+        { IExtendedProperties::MTime,  STATX_MTIME },
+        { IExtendedProperties::CTime,  STATX_CTIME },
+        { IExtendedProperties::Inode,  STATX_INO },
+        { IExtendedProperties::Size,   STATX_SIZE },
+        { IExtendedProperties::Blocks, STATX_BLOCKS },
+        { IExtendedProperties::BTime,  STATX_BTIME }
+    };
+
+    inline struct timespec timespec(const struct statx_timestamp &time)
+    {
+        struct timespec res = { time.tv_sec, time.tv_nsec };
+        return res;
+    }
+
+}
+
+
+IExtendedProperties::~IExtendedProperties()
+{}
+
+bool IExtendedProperties::query(int directory, const char *path, int flags, int fields, Values &values)
+{
+    unsigned int mask = 0;
+    struct statx st;
+
+    for (auto &i : s_fields)
+        if (fields & i.field)
+            mask |= i.mask;
+
+    if (::statx(directory, path, flags, mask, &st) != 0)
+        return false;
+
+    /* Device and anything the filesystem gave for free come along */
+    values.fields = Device;
+
+    for (auto &i : s_fields)
+        if ((st.stx_mask & i.mask) == i.mask)
+            values.fields |= i.field;
+
+    values.mode = st.stx_mode;
+    values.links = st.stx_nlink;
+    values.uid = st.stx_uid;
+    values.gid = st.stx_gid;
+    values.inode = st.stx_ino;
+    values.device = makedev(st.stx_dev_major, st.stx_dev_minor);
+    values.size = st.stx_size;
+    values.blocks = st.stx_blocks;
+    values.aTime = timespec(st.stx_atime);
+    values.mTime = timespec(st.stx_mtime);
+    values.cTime = timespec(st.stx_ctime);
+    values.bTime = timespec(st.stx_btime);
+
+    return true;
+}
+
+}
@@ -0,0 +1,94 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_IEXTENDEDPROPERTIES_H_
+#define LVFS_IEXTENDEDPROPERTIES_H_
+
+#include <time.h>
+#include <sys/types.h>
+#include <lvfs/Error>
+#include <lvfs/Interface>
+
+
+namespace LVFS {
+
+/**
+ * Properties of an entry beyond IProperties, computed on request.
+ *
+ * properties() gets only the given Fields, Values::fields tells which
+ * of them (and possibly others) are filled, e.g. BTime is not known by
+ * every filesystem. Local entries get them with one statx() asking for
+ * exactly these fields, see query().
+ */
+class PLATFORM_MAKE_PUBLIC IExtendedProperties
+{
+    DECLARE_INTERFACE(LVFS::IExtendedProperties)
+
+public:
+    enum Fields
+    {
+        Type   = 0x1,
+        Mode   = 0x1 << 1,
+        Links  = 0x1 << 2,
+        Owner  = 0x1 << 3,
+        ATime  = 0x1 << 4,
+        MTime  = 0x1 << 5,
+        CTime  = 0x1 << 6,
+        Inode  = 0x1 << 7,
+        Size   = 0x1 << 8,
+        Blocks = 0x1 << 9,
+        BTime  = 0x1 << 10,
+        Device = 0x1 << 11,
+        All    = (0x1 << 12) - 1
+    };
+
+    struct Values
+    {
+        int fields;
+        mode_t mode;
+        nlink_t links;
+        uid_t uid;
+        gid_t gid;
+        ino_t inode;
+        dev_t device;
+        off64_t size;
+        blkcnt_t blocks;
+        struct timespec aTime;
+        struct timespec mTime;
+        struct timespec cTime;
+        struct timespec bTime;
+    };
+
+public:
+    virtual ~IExtendedProperties();
+
+    virtual bool properties(int fields, Values &values) const = 0;
+    virtual const Error &lastError() const = 0;
+
+protected:
+    /**
+     * One statx() of \a path relative to \a directory with \a flags
+     * (AT_* of statx()), on failure errno tells why.
+     */
+    static bool query(int directory, const char *path, int flags, int fields, Values &values);
+};
+
+}
+
+#endif /* LVFS_IEXTENDEDPROPERTIES_H_ */
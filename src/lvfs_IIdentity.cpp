@@ -0,0 +1,56 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_IIdentity.h"
+
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+
+namespace LVFS {
+
+IIdentity::~IIdentity()
+{}
+
+uint32_t IIdentity::generation() const
+{
+    return 0;
+}
+
+bool IIdentity::key(int fd, Key &key)
+{
+    struct stat st;
+    int generation;
+
+    if (::fstat(fd, &st) != 0)
+        return false;
+
+    /* Not every filesystem has generations */
+    if (::ioctl(fd, FS_IOC_GETVERSION, &generation) != 0)
+        generation = 0;
+
+    key.device = st.st_dev;
+    key.inode = st.st_ino;
+    key.generation = generation;
+
+    return true;
+}
+
+}
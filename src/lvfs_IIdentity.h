@@ -0,0 +1,81 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_IIDENTITY_H_
+#define LVFS_IIDENTITY_H_
+
+#include <cstdint>
+#include <sys/types.h>
+#include <lvfs/Interface>
+
+
+namespace LVFS {
+
+/**
+ * Implemented by entries which know the file they refer to.
+ * Entries with equal device() and inode() are the same file,
+ * whatever their locations are.
+ *
+ * generation() tells files reusing an inode apart, where the
+ * filesystem has it (FS_IOC_GETVERSION), 0 otherwise. key() of
+ * entries of the same file is the same over symlinks and bind
+ * mounts, so caches use it rather than locations.
+ */
+class PLATFORM_MAKE_PUBLIC IIdentity
+{
+    DECLARE_INTERFACE(LVFS::IIdentity)
+
+public:
+    struct Key
+    {
+        dev_t device;
+        ino_t inode;
+        uint32_t generation;
+
+        inline bool operator<(const Key &other) const
+        {
+            return device < other.device ||
+                   (device == other.device && (inode < other.inode ||
+                   (inode == other.inode && generation < other.generation)));
+        }
+        inline bool operator==(const Key &other) const
+        {
+            return device == other.device && inode == other.inode && generation == other.generation;
+        }
+    };
+
+public:
+    virtual ~IIdentity();
+
+    virtual dev_t device() const = 0;
+    virtual ino_t inode() const = 0;
+    virtual nlink_t links() const = 0;
+    virtual uint32_t generation() const;
+
+    inline Key key() const { Key res = { device(), inode(), generation() }; return res; }
+
+    /**
+     * Key of the file open as \a fd, on failure errno tells why.
+     */
+    static bool key(int fd, Key &key);
+};
+
+}
+
+#endif /* LVFS_IIDENTITY_H_ */
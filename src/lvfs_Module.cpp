@@ -20,6 +20,8 @@
 #include "lvfs_Module.h"
 
 #include <lvfs/IEntry>
+#include <lvfs/IDirectory>
+#include <lvfs/BufferedStream>
 #include <lvfs/plugins/IPackage>
 #include <lvfs/plugins/IContentPlugin>
 #include <lvfs/plugins/IProtocolPlugin>
@@ -42,6 +44,41 @@ WARN_UNUSED_RETURN_OFF
 namespace LVFS {
 namespace {
     static Module *s_instance;
+
+    class BufferedEntry : public ExtendsBy<IEntry>
+    {
+    public:
+        BufferedEntry(const Interface::Holder &original) :
+            ExtendsBy<IEntry>(original),
+            m_entry(original->as<IEntry>())
+        {}
+
+        virtual ~BufferedEntry()
+        {}
+
+        virtual const char *title() const { return m_entry->title(); }
+        virtual const char *schema() const { return m_entry->schema(); }
+        virtual const char *location() const { return m_entry->location(); }
+        virtual const IType *type() const { return m_entry->type(); }
+
+        virtual Interface::Holder open(IStream::Mode mode) const
+        {
+            Interface::Holder res(m_entry->open(mode));
+
+            if (res.isValid() && res->as<BufferedStream>() == NULL)
+            {
+                Interface::Holder stream(new (std::nothrow) BufferedStream(res));
+
+                if (LIKELY(stream.isValid()))
+                    return stream;
+            }
+
+            return res;
+        }
+
+    private:
+        IEntry *m_entry;
+    };
 }
 
 const char Module::SchemaDelimiter[] = "://";
@@ -55,6 +92,8 @@ Module::Module(Settings::Instance &settings) :
     ASSERT(s_instance == NULL);
     s_instance = this;
 
+    m_settings.manage(&m_copySettings);
+
     if (const char *path = ::getenv("LVFS_PLUGINS_DIR"))
         if (DIR *dir = ::opendir(path))
         {
@@ -105,6 +144,12 @@ const Desktop &Module::desktop()
     return s_instance->m_desktop;
 }
 
+const Copy::Settings &Module::copySettings()
+{
+    ASSERT(s_instance != NULL);
+    return s_instance->m_copySettings;
+}
+
 Interface::Holder Module::open(const char *uri, Error &error)
 {
     ASSERT(s_instance != NULL);
@@ -168,9 +213,29 @@ Interface::Holder Module::internalOpen(const Interface::Holder &file)
                 return res;
         }
 
+    if (file->as<IDirectory>() == NULL && isUnbuffered(entry->schema()))
+    {
+        res = Interface::Holder(new (std::nothrow) BufferedEntry(file));
+
+        if (LIKELY(res.isValid()))
+            return res;
+    }
+
     return file;
 }
 
+bool Module::isUnbuffered(const char *schema) const
+{
+    auto root = m_protocolPlugins.find(schema);
+
+    if (root != m_protocolPlugins.end())
+        for (auto i : (*root).second)
+            if (i->flags() & IProtocolPlugin::Unbuffered)
+                return true;
+
+    return false;
+}
+
 void Module::processPlugin(const char *fileName)
 {
     Plugin plugin = { ::dlopen(fileName, RTLD_LAZY | RTLD_GLOBAL), NULL };
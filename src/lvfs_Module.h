@@ -29,6 +29,7 @@
 #include <lvfs/Interface>
 #include <lvfs/plugins/Package>
 #include <lvfs/settings/Instance>
+#include <lvfs/copy/Settings>
 #include <lvfs/Desktop>
 
 
@@ -61,12 +62,14 @@ public:
     ~Module();
 
     static const Desktop &desktop();
+    static const Copy::Settings &copySettings();
     static Interface::Holder open(const char *uri, Error &error);
     static Interface::Holder open(const Interface::Holder &file);
 
 private:
     Interface::Holder internalOpen(const char *uri, Error &error);
     Interface::Holder internalOpen(const Interface::Holder &file);
+    bool isUnbuffered(const char *schema) const;
     void processPlugin(const char *fileName);
 
 private:
@@ -105,6 +108,7 @@ private:
 
 private:
     Desktop m_desktop;
+    Copy::Settings m_copySettings;
 };
 
 }
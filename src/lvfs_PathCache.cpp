@@ -0,0 +1,429 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_PathCache.h"
+#include "lvfs_Checksum.h"
+
+#include <efc/List>
+#include <efc/Map>
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+
+namespace LVFS {
+
+namespace {
+
+    struct Directory
+    {
+        char *path;
+        int descriptor;
+        int users;
+        bool detached;
+        long long time;
+    };
+
+    struct Link
+    {
+        char *path;
+        char *resolved;
+        long long time;
+    };
+
+    static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+    static ::EFC::Map<uint64_t, Directory *> s_directories;
+    static ::EFC::List<Directory *> s_order;
+    static ::EFC::Map<uint64_t, Link> s_links;
+    static ::EFC::List<uint64_t> s_linkOrder;
+    static int s_ttl = PathCache::DefaultTtl;
+    static size_t s_limit = 0;
+    static size_t s_hits = 0;
+    static size_t s_misses = 0;
+
+
+    inline long long now()
+    {
+        struct timespec time;
+        ::clock_gettime(CLOCK_MONOTONIC, &time);
+        return time.tv_sec * 1000ll + time.tv_nsec / 1000000;
+    }
+
+    inline uint64_t hash(const char *path, size_t len)
+    {
+        return Checksum::xxHash64(path, len);
+    }
+
+    inline bool isUnder(const char *path, const char *prefix, size_t len)
+    {
+        return std::strncmp(path, prefix, len) == 0 && (path[len] == 0 || path[len] == '/' || len == 1);
+    }
+
+    inline size_t defaultLimit()
+    {
+        struct rlimit limit;
+
+        if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur / 8 < PathCache::DefaultLimit)
+            return limit.rlim_cur / 8;
+
+        return PathCache::DefaultLimit;
+    }
+
+    inline void destroy(Directory *directory)
+    {
+        ::close(directory->descriptor);
+        ::free(directory->path);
+        delete directory;
+    }
+
+    /* Out of the cache, closed when the last user releases it */
+    void detach(::EFC::Map<uint64_t, Directory *>::iterator i)
+    {
+        Directory *directory = (*i).second;
+
+        s_directories.erase(i);
+
+        for (auto j = s_order.begin(); j != s_order.end(); ++j)
+            if (*j == directory)
+            {
+                s_order.erase(j);
+                break;
+            }
+
+        if (directory->users == 0)
+            destroy(directory);
+        else
+            directory->detached = true;
+    }
+
+    void dropLink(::EFC::Map<uint64_t, Link>::iterator i)
+    {
+        for (auto j = s_linkOrder.begin(); j != s_linkOrder.end(); ++j)
+            if (*j == (*i).first)
+            {
+                s_linkOrder.erase(j);
+                break;
+            }
+
+        ::free((*i).second.path);
+        ::free((*i).second.resolved);
+        s_links.erase(i);
+    }
+
+    /* Closes the oldest unused ones until "size" more fit into the limit */
+    void shrink(size_t size)
+    {
+        for (auto i = s_order.begin(); i != s_order.end() && s_directories.size() + size > s_limit;)
+            if ((*i)->users == 0)
+            {
+                Directory *directory = *i;
+                s_order.erase(i++);
+                s_directories.erase(hash(directory->path, std::strlen(directory->path)));
+                destroy(directory);
+            }
+            else
+                ++i;
+    }
+
+    /* Cached and fresh one, with a user added */
+    Directory *find(const char *path, size_t len, long long time)
+    {
+        auto i = s_directories.find(hash(path, len));
+
+        if (i == s_directories.end())
+            return NULL;
+
+        Directory *res = (*i).second;
+
+        if (std::strncmp(res->path, path, len) != 0 || res->path[len] != 0)
+            return NULL;
+
+        if (time - res->time >= s_ttl)
+        {
+            detach(i);
+            return NULL;
+        }
+
+        ++res->users;
+        return res;
+    }
+
+    void release(Directory *directory)
+    {
+        ::pthread_mutex_lock(&s_mutex);
+
+        if (--directory->users == 0 && directory->detached)
+            destroy(directory);
+
+        ::pthread_mutex_unlock(&s_mutex);
+    }
+
+    /* O_PATH descriptor of the first "len" bytes of "path" */
+    Directory *acquire(const char *path, size_t len)
+    {
+        char buffer[PATH_MAX];
+        Directory *ancestor = NULL;
+        Directory *res;
+        size_t ancestorLen = 0;
+        long long time = now();
+        int fd;
+
+        if (UNLIKELY(len >= sizeof(buffer)))
+            return NULL;
+
+        ::pthread_mutex_lock(&s_mutex);
+
+        if ((res = find(path, len, time)) != NULL)
+        {
+            ++s_hits;
+            ::pthread_mutex_unlock(&s_mutex);
+            return res;
+        }
+
+        ++s_misses;
+
+        /* The nearest cached ancestor saves walking the way to it */
+        for (ancestorLen = len; ancestorLen > 1 && ancestor == NULL;)
+        {
+            while (--ancestorLen > 0 && path[ancestorLen] != '/');
+            ancestor = find(path, ancestorLen > 0 ? ancestorLen : 1, time);
+        }
+
+        ::pthread_mutex_unlock(&s_mutex);
+
+        std::memcpy(buffer, path, len);
+        buffer[len] = 0;
+
+        if (ancestor == NULL)
+            fd = ::open(buffer, O_PATH | O_DIRECTORY | O_CLOEXEC);
+        else
+        {
+            fd = ::openat(ancestor->descriptor, buffer + ancestorLen + 1, O_PATH | O_DIRECTORY | O_CLOEXEC);
+            release(ancestor);
+        }
+
+        if (fd == -1 || UNLIKELY((res = new (std::nothrow) Directory) == NULL))
+        {
+            if (fd != -1)
+                ::close(fd);
+
+            return NULL;
+        }
+
+        if (UNLIKELY((res->path = ::strdup(buffer)) == NULL))
+        {
+            ::close(fd);
+            delete res;
+            return NULL;
+        }
+
+        res->descriptor = fd;
+        res->users = 1;
+        res->detached = false;
+        res->time = time;
+
+        ::pthread_mutex_lock(&s_mutex);
+
+        if (s_limit == 0)
+            s_limit = defaultLimit();
+
+        shrink(1);
+
+        /* Unless another thread did the same meanwhile, it stays private then */
+        if (s_directories.size() < s_limit && s_directories.find(hash(path, len)) == s_directories.end())
+        {
+            s_directories[hash(path, len)] = res;
+            s_order.push_back(res);
+        }
+        else
+            res->detached = true;
+
+        ::pthread_mutex_unlock(&s_mutex);
+        return res;
+    }
+
+}
+
+
+int PathCache::open(const char *path, int flags, mode_t mode)
+{
+    const char *name = std::strrchr(path, '/');
+    Directory *directory;
+    int res;
+
+    if (name == NULL || name[1] == 0 || path[0] != '/' ||
+        (directory = acquire(path, name == path ? 1 : name - path)) == NULL)
+    {
+        return ::open(path, flags, mode);
+    }
+
+    res = ::openat(directory->descriptor, name + 1, flags, mode);
+    release(directory);
+
+    return res;
+}
+
+bool PathCache::resolve(const char *path, char *buffer, size_t size)
+{
+    size_t len = std::strlen(path);
+    uint64_t key = hash(path, len);
+    long long time = now();
+    Link link;
+
+    ::pthread_mutex_lock(&s_mutex);
+    auto i = s_links.find(key);
+
+    if (i != s_links.end())
+        if (std::strcmp((*i).second.path, path) == 0 && time - (*i).second.time < s_ttl)
+        {
+            bool res = std::strlen((*i).second.resolved) < size;
+
+            if (res)
+                std::strcpy(buffer, (*i).second.resolved);
+
+            ++s_hits;
+            ::pthread_mutex_unlock(&s_mutex);
+            return res;
+        }
+        else
+            dropLink(i);
+
+    ++s_misses;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    if ((link.resolved = ::realpath(path, NULL)) == NULL)
+        return false;
+
+    if (std::strlen(link.resolved) >= size)
+    {
+        ::free(link.resolved);
+        errno = ENAMETOOLONG;
+        return false;
+    }
+
+    std::strcpy(buffer, link.resolved);
+
+    if (UNLIKELY((link.path = ::strdup(path)) == NULL))
+    {
+        ::free(link.resolved);
+        return true;
+    }
+
+    link.time = time;
+
+    ::pthread_mutex_lock(&s_mutex);
+
+    if ((i = s_links.find(key)) != s_links.end())
+        dropLink(i);
+
+    while (s_links.size() >= MaxLinks)
+        dropLink(s_links.find(s_linkOrder.front()));
+
+    s_links[key] = link;
+    s_linkOrder.push_back(key);
+
+    ::pthread_mutex_unlock(&s_mutex);
+    return true;
+}
+
+void PathCache::invalidate(const char *path)
+{
+    size_t len = std::strlen(path);
+
+    ::pthread_mutex_lock(&s_mutex);
+
+    for (auto i = s_directories.begin(); i != s_directories.end();)
+        if (isUnder((*i).second->path, path, len))
+            detach(i++);
+        else
+            ++i;
+
+    for (auto i = s_links.begin(); i != s_links.end();)
+        if (isUnder((*i).second.path, path, len) || isUnder((*i).second.resolved, path, len))
+            dropLink(i++);
+        else
+            ++i;
+
+    ::pthread_mutex_unlock(&s_mutex);
+}
+
+void PathCache::clear()
+{
+    invalidate("/");
+}
+
+int PathCache::ttl()
+{
+    return s_ttl;
+}
+
+void PathCache::setTtl(int ttl)
+{
+    ::pthread_mutex_lock(&s_mutex);
+    s_ttl = ttl;
+    ::pthread_mutex_unlock(&s_mutex);
+}
+
+size_t PathCache::limit()
+{
+    ::pthread_mutex_lock(&s_mutex);
+
+    if (s_limit == 0)
+        s_limit = defaultLimit();
+
+    size_t res = s_limit;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return res;
+}
+
+void PathCache::setLimit(size_t limit)
+{
+    ::pthread_mutex_lock(&s_mutex);
+    s_limit = limit > 0 ? limit : defaultLimit();
+    shrink(0);
+    ::pthread_mutex_unlock(&s_mutex);
+}
+
+size_t PathCache::hits()
+{
+    ::pthread_mutex_lock(&s_mutex);
+    size_t res = s_hits;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return res;
+}
+
+size_t PathCache::misses()
+{
+    ::pthread_mutex_lock(&s_mutex);
+    size_t res = s_misses;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return res;
+}
+
+}
@@ -0,0 +1,76 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_PATHCACHE_H_
+#define LVFS_PATHCACHE_H_
+
+#include <sys/types.h>
+#include <platform/utils.h>
+
+
+namespace LVFS {
+
+/**
+ * Process-wide cache of path resolution of local files.
+ *
+ * open() opens an absolute path by openat() relative to an O_PATH
+ * descriptor of its directory, which is cached, so that repeated opens
+ * in one directory walk only the last component. A directory missing
+ * in the cache is opened relative to its nearest cached ancestor.
+ * resolve() caches realpath() results, symlinks included.
+ *
+ * Everything cached is dropped after ttl() or by invalidate() of the
+ * path or of one of its ancestors, which plugins watching their
+ * directories call on renames and removals. At most limit() directory
+ * descriptors (an eighth of RLIMIT_NOFILE, at most DefaultLimit) and
+ * MaxLinks resolved paths are kept, the oldest unused ones are dropped
+ * first.
+ */
+class PLATFORM_MAKE_PUBLIC PathCache
+{
+public:
+    enum
+    {
+        DefaultTtl = 5000 /* ms */,
+        DefaultLimit = 64,
+        MaxLinks = 4096
+    };
+
+public:
+    /** As ::open(), \a path must be absolute. */
+    static int open(const char *path, int flags, mode_t mode = 0);
+    /** As ::realpath(), false if \a buffer is too small or on failure. */
+    static bool resolve(const char *path, char *buffer, size_t size);
+
+    /** Drops \a path and everything under it. */
+    static void invalidate(const char *path);
+    static void clear();
+
+    static int ttl();
+    static void setTtl(int ttl);
+    static size_t limit();
+    static void setLimit(size_t limit);
+
+    static size_t hits();
+    static size_t misses();
+};
+
+}
+
+#endif /* LVFS_PATHCACHE_H_ */
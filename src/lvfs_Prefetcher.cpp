@@ -0,0 +1,339 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_Prefetcher.h"
+
+#include <lvfs/IDescriptor>
+#include <brolly/assert.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace LVFS {
+
+Prefetcher::Prefetcher(const Interface::Holder &original, size_t maxWindow) :
+    ExtendsBy<IStream>(original),
+    m_stream(original->as<IStream>()),
+    m_descriptor(-1),
+    m_maxWindow(std::max<size_t>(maxWindow, MinWindow)),
+    m_window(0),
+    m_pattern(Unknown),
+    m_fixed(false),
+    m_offset(0),
+    m_last(0),
+    m_lastSize(0),
+    m_stride(0),
+    m_prefetched(0),
+    m_buffer(NULL),
+    m_bufferOffset(0),
+    m_bufferLen(0),
+    m_streamOffset(0)
+{
+    ASSERT(m_stream != NULL);
+
+    if (const IDescriptor *descriptor = original->as<IDescriptor>())
+        m_descriptor = descriptor->descriptor();
+}
+
+Prefetcher::~Prefetcher()
+{
+    ::free(m_buffer);
+}
+
+size_t Prefetcher::read(void *buffer, size_t size)
+{
+    size_t res;
+
+    if (m_offset >= 0 && !m_fixed)
+        observe(m_offset, size);
+
+    if (m_descriptor >= 0)
+    {
+        if (m_offset >= 0 && m_window > 0)
+            prefetch(size);
+
+        res = m_stream->read(buffer, size);
+    }
+    else
+        res = fetch(static_cast<char *>(buffer), size);
+
+    if (res == 0)
+        m_lastError = m_stream->lastError();
+    else if (m_offset >= 0)
+        m_offset += res;
+
+    return res;
+}
+
+size_t Prefetcher::write(const void *buffer, size_t size)
+{
+    size_t res;
+
+    if (m_descriptor < 0 && m_offset >= 0)
+    {
+        m_bufferLen = 0;
+
+        if (!sync(m_offset))
+            return 0;
+    }
+
+    if ((res = m_stream->write(buffer, size)) == 0)
+        m_lastError = m_stream->lastError();
+    else if (m_offset >= 0)
+    {
+        m_offset += res;
+
+        if (m_descriptor < 0)
+            m_streamOffset += res;
+    }
+
+    return res;
+}
+
+bool Prefetcher::advise(off64_t offset, off64_t len, Advise advise)
+{
+    if (offset == 0 && len == 0)
+        switch (advise)
+        {
+            case Normal:
+                m_fixed = false;
+                m_pattern = Unknown;
+                m_window = 0;
+                m_lastSize = 0;
+                break;
+
+            case Random:
+                m_fixed = true;
+                m_pattern = Random;
+                m_window = 0;
+                break;
+
+            case Sequential:
+                m_fixed = true;
+                m_pattern = Sequential;
+                m_window = m_maxWindow;
+                m_prefetched = m_offset;
+                break;
+
+            default:
+                break;
+        }
+
+    if (m_stream->advise(offset, len, advise))
+        return true;
+
+    m_lastError = m_stream->lastError();
+    return false;
+}
+
+bool Prefetcher::seek(off64_t offset, Whence whence)
+{
+    if (whence == FromCurrent && m_offset >= 0)
+    {
+        offset += m_offset;
+        whence = FromBeginning;
+    }
+
+    if (m_descriptor < 0 && whence == FromBeginning)
+    {
+        if (offset < 0)
+        {
+            m_lastError = Error(EINVAL);
+            return false;
+        }
+
+        /* The original stream is moved by the next read or write, if needed */
+        m_offset = offset;
+        return true;
+    }
+
+    if (!m_stream->seek(offset, whence))
+    {
+        m_lastError = m_stream->lastError();
+        return false;
+    }
+
+    /* Behind a buffer the descriptor is ahead of the stream, ask it only if there is no other way */
+    if (m_descriptor >= 0)
+        m_offset = whence == FromBeginning ? offset : ::lseek64(m_descriptor, 0, SEEK_CUR);
+    else
+    {
+        /* Offset from the end is unknown, detection is off till the next absolute seek */
+        m_offset = m_streamOffset = -1;
+        m_bufferLen = 0;
+    }
+
+    return true;
+}
+
+bool Prefetcher::flush()
+{
+    if (m_stream->flush())
+        return true;
+
+    m_lastError = m_stream->lastError();
+    return false;
+}
+
+const Error &Prefetcher::lastError() const
+{
+    return m_lastError;
+}
+
+void *Prefetcher::interface(uint32_t id)
+{
+    if (id == interfaceId())
+        return this;
+    else
+        return ExtendsBy<IStream>::interface(id);
+}
+
+void Prefetcher::observe(off64_t offset, size_t size)
+{
+    off64_t stride = offset - m_last;
+
+    if (m_lastSize > 0)
+        if (stride == static_cast<off64_t>(m_lastSize))
+            setPattern(Sequential);
+        else if (stride > static_cast<off64_t>(m_lastSize) && stride == m_stride)
+            setPattern(Strided);
+        else
+            setPattern(Random);
+
+    m_stride = stride;
+    m_last = offset;
+    m_lastSize = size;
+}
+
+void Prefetcher::setPattern(Pattern pattern)
+{
+    if (pattern == m_pattern)
+        return;
+
+    m_pattern = pattern;
+    m_window = pattern == Random ? 0 : MinWindow;
+    m_prefetched = m_offset;
+
+    if (m_descriptor >= 0)
+        ::posix_fadvise64(m_descriptor, 0, 0, pattern == Sequential ? POSIX_FADV_SEQUENTIAL : POSIX_FADV_RANDOM);
+}
+
+void Prefetcher::prefetch(size_t size)
+{
+    off64_t end = m_offset + size;
+    off64_t target;
+    off64_t next;
+
+    if (m_pattern == Strided)
+    {
+        next = m_offset + m_stride;
+        target = m_prefetched;
+
+        for (size_t i = 0; i < MaxStrides && i * size < m_window; ++i, next += m_stride)
+            if (next >= m_prefetched)
+            {
+                ::posix_fadvise64(m_descriptor, next, size, POSIX_FADV_WILLNEED);
+                m_prefetched = next + 1;
+            }
+
+        if (m_prefetched != target)
+            m_window = std::min(m_window * 2, m_maxWindow);
+    }
+    else
+    {
+        next = std::max(m_prefetched, end);
+        target = end + static_cast<off64_t>(m_window);
+
+        /* Ask for more once half of the window has been consumed */
+        if (target - next >= static_cast<off64_t>(m_window / 2))
+        {
+            ::readahead(m_descriptor, next, target - next);
+            m_prefetched = target;
+            m_window = std::min(m_window * 2, m_maxWindow);
+        }
+    }
+}
+
+size_t Prefetcher::fetch(char *buffer, size_t size)
+{
+    size_t res = 0;
+    size_t len;
+    off64_t offset;
+
+    if (m_offset < 0)
+        return m_stream->read(buffer, size);
+
+    while (res < size)
+    {
+        offset = m_offset + res;
+
+        if (offset >= m_bufferOffset && offset < m_bufferOffset + static_cast<off64_t>(m_bufferLen))
+        {
+            len = std::min<off64_t>(size - res, m_bufferOffset + m_bufferLen - offset);
+            ::memcpy(buffer + res, m_buffer + (offset - m_bufferOffset), len);
+            res += len;
+            continue;
+        }
+
+        if (!sync(offset))
+            break;
+
+        /* Large reads and records far apart are not worth buffering */
+        if (m_window <= size - res || (m_pattern == Strided && m_stride >= static_cast<off64_t>(m_window)) ||
+            (m_buffer == NULL && (m_buffer = static_cast<char *>(::malloc(m_maxWindow))) == NULL))
+        {
+            len = m_stream->read(buffer + res, size - res);
+            m_streamOffset += len;
+            return res + len;
+        }
+
+        m_bufferOffset = offset;
+        m_bufferLen = m_stream->read(m_buffer, m_window);
+        m_streamOffset += m_bufferLen;
+        m_window = std::min(m_window * 2, m_maxWindow);
+
+        if (m_bufferLen == 0)
+            break;
+    }
+
+    return res;
+}
+
+bool Prefetcher::sync(off64_t offset)
+{
+    if (m_streamOffset == offset)
+        return true;
+
+    if (!m_stream->seek(offset))
+    {
+        m_lastError = m_stream->lastError();
+        m_streamOffset = -1;
+        return false;
+    }
+
+    m_streamOffset = offset;
+    return true;
+}
+
+}
@@ -0,0 +1,125 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_PREFETCHER_H_
+#define LVFS_PREFETCHER_H_
+
+#include <lvfs/IStream>
+
+
+namespace LVFS {
+
+/**
+ * Adaptive read-ahead on top of any IStream.
+ *
+ * Offsets and sizes of reads are compared with the previous ones to
+ * tell sequential and strided access from random one. The window
+ * starts at MinWindow once a pattern is seen, doubles every time it is
+ * fetched, up to the maximum, and is dropped on random access.
+ *
+ * For local streams (those implementing IDescriptor) reads go to the
+ * original stream and the kernel is asked to fetch ahead: readahead()
+ * of the next window for sequential access, POSIX_FADV_WILLNEED of the
+ * next records for strided one. The file is advised Sequential or
+ * Random accordingly, so that the kernel's own heuristics don't fight.
+ *
+ * Other streams are read ahead into an own buffer of the window size.
+ *
+ * The original stream is expected to be at its beginning. The offset
+ * is tracked from reads, writes and seeks, the descriptor is asked for
+ * it only after a seek from the end.
+ *
+ * Explicit advise() for the whole stream overrides the detection:
+ * Random turns read-ahead off, Sequential starts at the maximum window,
+ * Normal goes back to detection.
+ */
+class PLATFORM_MAKE_PUBLIC Prefetcher : public ExtendsBy<IStream>
+{
+    DECLARE_INTERFACE(LVFS::Prefetcher)
+
+public:
+    enum Pattern
+    {
+        Unknown,
+        Sequential,
+        Strided,
+        Random
+    };
+
+    enum
+    {
+        MinWindow = 128 * 1024,
+        DefaultMaxWindow = 4 * 1024 * 1024,
+        MaxStrides = 16
+    };
+
+public:
+    Prefetcher(const Interface::Holder &original, size_t maxWindow = DefaultMaxWindow);
+    virtual ~Prefetcher();
+
+    inline Pattern pattern() const { return m_pattern; }
+    /** Current read-ahead window in bytes, 0 if read-ahead is off. */
+    inline size_t window() const { return m_window; }
+    inline size_t maxWindow() const { return m_maxWindow; }
+
+    /* IStream */
+
+    virtual size_t read(void *buffer, size_t size);
+    virtual size_t write(const void *buffer, size_t size);
+    virtual bool advise(off64_t offset, off64_t len, Advise advise);
+    virtual bool seek(off64_t offset, Whence whence = FromBeginning);
+    virtual bool flush();
+
+    virtual const Error &lastError() const;
+
+protected:
+    virtual void *interface(uint32_t id);
+
+private:
+    void observe(off64_t offset, size_t size);
+    void setPattern(Pattern pattern);
+    void prefetch(size_t size);
+    size_t fetch(char *buffer, size_t size);
+    bool sync(off64_t offset);
+
+private:
+    IStream *m_stream;
+    int m_descriptor;
+    size_t m_maxWindow;
+    size_t m_window;
+    Pattern m_pattern;
+    bool m_fixed;
+
+    off64_t m_offset;
+    off64_t m_last;
+    size_t m_lastSize;
+    off64_t m_stride;
+    off64_t m_prefetched;
+
+    char *m_buffer;
+    off64_t m_bufferOffset;
+    size_t m_bufferLen;
+    off64_t m_streamOffset;
+
+    Error m_lastError;
+};
+
+}
+
+#endif /* LVFS_PREFETCHER_H_ */
@@ -0,0 +1,304 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lvfs_PropertyCache.h"
+#include "lvfs_IEntry.h"
+#include "lvfs_IIdentity.h"
+#include "lvfs_IProperties.h"
+
+#include <efc/List>
+#include <efc/Map>
+
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <sys/stat.h>
+
+
+namespace LVFS {
+
+namespace {
+
+    typedef IIdentity::Key Key;
+
+    struct Record
+    {
+        off64_t size;
+        time_t cTime;
+        time_t mTime;
+        time_t aTime;
+        int permissions;
+        long long time;
+        ::EFC::List<Key>::iterator order;
+    };
+
+    /* Approximately, with the nodes of the map and of the list */
+    static const size_t RecordSize = sizeof(Key) + sizeof(Record) + 4 * sizeof(void *) + sizeof(Key) + 2 * sizeof(void *);
+
+    static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+    static ::EFC::Map<Key, Record> s_records;
+    static ::EFC::List<Key> s_order;
+    static int s_ttl = PropertyCache::DefaultTtl;
+    static size_t s_limit = PropertyCache::DefaultLimit;
+    static size_t s_hits = 0;
+    static size_t s_misses = 0;
+
+
+    inline long long now()
+    {
+        struct timespec time;
+        ::clock_gettime(CLOCK_MONOTONIC, &time);
+        return time.tv_sec * 1000ll + time.tv_nsec / 1000000;
+    }
+
+    inline int permissions(mode_t mode)
+    {
+        int res = 0;
+
+        if (mode & S_IRUSR)
+            res |= IProperties::Read;
+
+        if (mode & S_IWUSR)
+            res |= IProperties::Write;
+
+        if (mode & S_IXUSR)
+            res |= IProperties::Exec;
+
+        return res;
+    }
+
+    inline void drop(::EFC::Map<Key, Record>::iterator record)
+    {
+        s_order.erase((*record).second.order);
+        s_records.erase(record);
+    }
+
+    /* The most recently used records are at the back of s_order */
+    inline void touch(::EFC::Map<Key, Record>::iterator record)
+    {
+        s_order.erase((*record).second.order);
+        s_order.push_back((*record).first);
+        (*record).second.order = --s_order.end();
+    }
+
+    void shrink(size_t size)
+    {
+        while (!s_order.empty() && s_records.size() * RecordSize + size > s_limit)
+            drop(s_records.find(s_order.front()));
+    }
+
+    /* Reads all of them, outside of the lock */
+    bool fetch(const Interface::Holder &original, Record &record)
+    {
+        const IEntry *entry = original->as<IEntry>();
+        const IProperties *props;
+        struct stat st;
+
+        if (entry != NULL && std::strcmp(entry->schema(), "file") == 0 && ::stat(entry->location(), &st) == 0)
+        {
+            record.size = st.st_size;
+            record.cTime = st.st_ctime;
+            record.mTime = st.st_mtime;
+            record.aTime = st.st_atime;
+            record.permissions = permissions(st.st_mode);
+        }
+        else if ((props = original->as<IProperties>()) != NULL)
+        {
+            record.size = props->size();
+            record.cTime = props->cTime();
+            record.mTime = props->mTime();
+            record.aTime = props->aTime();
+            record.permissions = props->permissions();
+        }
+        else
+            return false;
+
+        record.time = now();
+        return true;
+    }
+
+
+    class Entry : public ExtendsBy<IProperties>
+    {
+    public:
+        Entry(const Interface::Holder &original, const Key &key) :
+            ExtendsBy<IProperties>(original),
+            m_key(key)
+        {}
+        virtual ~Entry()
+        {}
+
+        /* IProperties */
+
+        virtual off64_t size() const { return properties().size; }
+        virtual time_t cTime() const { return properties().cTime; }
+        virtual time_t mTime() const { return properties().mTime; }
+        virtual time_t aTime() const { return properties().aTime; }
+        virtual int permissions() const { return properties().permissions; }
+
+    private:
+        Record properties() const;
+
+    private:
+        Key m_key;
+    };
+
+    Record Entry::properties() const
+    {
+        Record res;
+
+        ::pthread_mutex_lock(&s_mutex);
+        auto i = s_records.find(m_key);
+
+        if (i != s_records.end() && now() - (*i).second.time < s_ttl)
+        {
+            touch(i);
+            res = (*i).second;
+            ++s_hits;
+            ::pthread_mutex_unlock(&s_mutex);
+            return res;
+        }
+
+        ++s_misses;
+        ::pthread_mutex_unlock(&s_mutex);
+
+        if (!fetch(original(), res))
+            return Record();
+
+        ::pthread_mutex_lock(&s_mutex);
+
+        if ((i = s_records.find(m_key)) != s_records.end())
+        {
+            res.order = (*i).second.order;
+            (*i).second = res;
+            touch(i);
+        }
+        else if (RecordSize <= s_limit)
+        {
+            shrink(RecordSize);
+            s_order.push_back(m_key);
+            res.order = --s_order.end();
+            s_records[m_key] = res;
+        }
+
+        ::pthread_mutex_unlock(&s_mutex);
+        return res;
+    }
+
+}
+
+
+Interface::Holder PropertyCache::wrap(const Interface::Holder &entry)
+{
+    const IIdentity *identity;
+
+    if (!entry.isValid() || (identity = entry->as<IIdentity>()) == NULL || entry->as<IProperties>() == NULL)
+        return entry;
+
+    Interface::Holder res(new (std::nothrow) Entry(entry, identity->key()));
+
+    return res.isValid() ? res : entry;
+}
+
+void PropertyCache::invalidate(const IIdentity::Key &key)
+{
+    ::pthread_mutex_lock(&s_mutex);
+    auto i = s_records.find(key);
+
+    if (i != s_records.end())
+        drop(i);
+
+    ::pthread_mutex_unlock(&s_mutex);
+}
+
+void PropertyCache::invalidate(const Interface::Holder &entry)
+{
+    if (const IIdentity *identity = entry->as<IIdentity>())
+        invalidate(identity->key());
+}
+
+void PropertyCache::clear()
+{
+    ::pthread_mutex_lock(&s_mutex);
+    s_records.clear();
+    s_order.clear();
+    ::pthread_mutex_unlock(&s_mutex);
+}
+
+int PropertyCache::ttl()
+{
+    ::pthread_mutex_lock(&s_mutex);
+    int res = s_ttl;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return res;
+}
+
+void PropertyCache::setTtl(int ttl)
+{
+    ::pthread_mutex_lock(&s_mutex);
+    s_ttl = ttl;
+    ::pthread_mutex_unlock(&s_mutex);
+}
+
+size_t PropertyCache::limit()
+{
+    ::pthread_mutex_lock(&s_mutex);
+    size_t res = s_limit;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return res;
+}
+
+void PropertyCache::setLimit(size_t limit)
+{
+    ::pthread_mutex_lock(&s_mutex);
+    s_limit = limit;
+    shrink(0);
+    ::pthread_mutex_unlock(&s_mutex);
+}
+
+size_t PropertyCache::hits()
+{
+    ::pthread_mutex_lock(&s_mutex);
+    size_t res = s_hits;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return res;
+}
+
+size_t PropertyCache::misses()
+{
+    ::pthread_mutex_lock(&s_mutex);
+    size_t res = s_misses;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return res;
+}
+
+size_t PropertyCache::used()
+{
+    ::pthread_mutex_lock(&s_mutex);
+    size_t res = s_records.size() * RecordSize;
+    ::pthread_mutex_unlock(&s_mutex);
+
+    return res;
+}
+
+}
@@ -0,0 +1,73 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LVFS_PROPERTYCACHE_H_
+#define LVFS_PROPERTYCACHE_H_
+
+#include <lvfs/IIdentity>
+
+
+namespace LVFS {
+
+/**
+ * Process-wide cache of IProperties.
+ *
+ * wrap() returns the entry extended by IProperties answered from the
+ * cache, which is keyed by IIdentity, so all entries of one file share
+ * one record. Records are refreshed after ttl(), by stat() for local
+ * ("file" schema) entries and by the original IProperties otherwise.
+ *
+ * Plugins watching their directories (e.g. by inotify) call invalidate()
+ * on changes. Records never take more than limit() bytes, the least
+ * recently used ones are dropped first.
+ */
+class PLATFORM_MAKE_PUBLIC PropertyCache
+{
+public:
+    enum
+    {
+        DefaultTtl = 2000 /* ms */
+    };
+
+    static const size_t DefaultLimit = 16 * 1024 * 1024;
+
+public:
+    /**
+     * Entries without IIdentity or IProperties are returned as is.
+     */
+    static Interface::Holder wrap(const Interface::Holder &entry);
+
+    static void invalidate(const IIdentity::Key &key);
+    static void invalidate(const Interface::Holder &entry);
+    static void clear();
+
+    static int ttl();
+    static void setTtl(int ttl);
+    static size_t limit();
+    static void setLimit(size_t limit);
+
+    static size_t hits();
+    static size_t misses();
+    /** Bytes taken by the records. */
+    static size_t used();
+};
+
+}
+
+#endif /* LVFS_PROPERTYCACHE_H_ */
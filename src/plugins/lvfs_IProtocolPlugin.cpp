@@ -28,4 +28,9 @@ IProtocolPlugin::IProtocolPlugin()
 IProtocolPlugin::~IProtocolPlugin()
 {}
 
+int IProtocolPlugin::flags() const
+{
+    return 0;
+}
+
 }
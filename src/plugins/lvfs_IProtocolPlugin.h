@@ -30,10 +30,18 @@ class PLATFORM_MAKE_PUBLIC IProtocolPlugin
 {
     DECLARE_INTERFACE(LVFS::IProtocolPlugin)
 
+public:
+    enum Flags
+    {
+        /** Streams of this protocol go straight to syscalls, Module will buffer them. */
+        Unbuffered = 0x1
+    };
+
 public:
     IProtocolPlugin();
     virtual ~IProtocolPlugin();
 
+    virtual int flags() const;
     virtual Interface::Holder open(const char *uri) const = 0;
     virtual const Error &lastError() const = 0;
 };
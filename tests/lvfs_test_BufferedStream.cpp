@@ -0,0 +1,200 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lvfs/BufferedStream>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace {
+using namespace LVFS;
+
+class FileStream : public Implements<IStream>
+{
+public:
+    FileStream(int fd) :
+        m_fd(fd)
+    {}
+
+    virtual ~FileStream()
+    {
+        ::close(m_fd);
+    }
+
+    virtual size_t read(void *buffer, size_t size)
+    {
+        ssize_t res = ::read(m_fd, buffer, size);
+
+        if (res < 0)
+        {
+            m_lastError = Error(errno);
+            return 0;
+        }
+
+        return res;
+    }
+
+    virtual size_t write(const void *buffer, size_t size)
+    {
+        ssize_t res = ::write(m_fd, buffer, size);
+
+        if (res < 0)
+        {
+            m_lastError = Error(errno);
+            return 0;
+        }
+
+        return res;
+    }
+
+    virtual bool advise(off64_t offset, off64_t len, Advise advise)
+    {
+        return true;
+    }
+
+    virtual bool seek(off64_t offset, Whence whence)
+    {
+        static const int whences[] = { SEEK_SET, SEEK_CUR, SEEK_END };
+
+        if (::lseek64(m_fd, offset, whences[whence]) < 0)
+        {
+            m_lastError = Error(errno);
+            return false;
+        }
+
+        return true;
+    }
+
+    virtual bool flush()
+    {
+        return true;
+    }
+
+    virtual const Error &lastError() const
+    {
+        return m_lastError;
+    }
+
+private:
+    int m_fd;
+    Error m_lastError;
+};
+
+enum
+{
+    FileSize = 64 * 1024,
+    BufferSize = 4096
+};
+
+inline char pattern(size_t offset)
+{
+    return static_cast<char>(offset % 251);
+}
+
+bool check(const char *buffer, size_t offset, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+        if (buffer[i] != pattern(offset + i))
+        {
+            ::fprintf(stderr, "Mismatch at offset %zu\n", offset + i);
+            return false;
+        }
+
+    return true;
+}
+
+bool read(IStream *stream, size_t &offset, size_t size)
+{
+    static char buffer[FileSize];
+
+    if (stream->read(buffer, size) != size)
+    {
+        ::fprintf(stderr, "Short read of %zu bytes at offset %zu\n", size, offset);
+        return false;
+    }
+
+    if (!check(buffer, offset, size))
+        return false;
+
+    offset += size;
+    return true;
+}
+
+/* Seeking back right after a read that bypassed the buffer must not see the buffer */
+bool seekAfterDirectRead(const Interface::Holder &file)
+{
+    BufferedStream stream(file, BufferSize);
+    size_t offset = 0;
+
+    if (!read(&stream, offset, 100) ||
+        !read(&stream, offset, 3996) ||
+        !read(&stream, offset, 10000))
+        return false;
+
+    if (!stream.seek(-10, IStream::FromCurrent))
+    {
+        ::fprintf(stderr, "Seek failed\n");
+        return false;
+    }
+
+    offset -= 10;
+    return read(&stream, offset, 10);
+}
+
+}
+
+
+int main()
+{
+    char name[] = "/tmp/lvfs_test_BufferedStream.XXXXXX";
+    int fd = ::mkstemp(name);
+
+    if (fd < 0)
+    {
+        ::perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+
+    ::unlink(name);
+
+    char data[FileSize];
+
+    for (size_t i = 0; i < FileSize; ++i)
+        data[i] = pattern(i);
+
+    if (::write(fd, data, FileSize) != FileSize || ::lseek64(fd, 0, SEEK_SET) != 0)
+    {
+        ::perror("write");
+        ::close(fd);
+        return EXIT_FAILURE;
+    }
+
+    Interface::Holder file(new (std::nothrow) FileStream(fd));
+
+    if (!seekAfterDirectRead(file))
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
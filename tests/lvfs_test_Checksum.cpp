@@ -0,0 +1,177 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lvfs/Checksum>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace {
+using namespace LVFS;
+
+struct Vector
+{
+    Checksum::Algorithm algorithm;
+    const char *data;
+    uint64_t value;
+};
+
+/* Check values of the CRC catalogue and of the xxHash reference implementation */
+const Vector vectors[] =
+{
+    { Checksum::Crc32,    "",                                        0 },
+    { Checksum::Crc32,    "123456789",                               0xCBF43926 },
+    { Checksum::Crc32c,   "",                                        0 },
+    { Checksum::Crc32c,   "123456789",                               0xE3069283 },
+    { Checksum::XxHash64, "",                                        0xEF46DB3751D8E999ull },
+    { Checksum::XxHash64, "a",                                       0xD24EC4F1A98C6E5Bull },
+    { Checksum::XxHash64, "abc",                                     0x44BC2CF5AD770999ull },
+    { Checksum::XxHash64, "123456789",                               0x8CB841DB40E6AE83ull },
+    { Checksum::XxHash64, "Nobody inspects the spammish repetition", 0xFBCEA83C8A378BF1ull }
+};
+
+const char *name(Checksum::Algorithm algorithm)
+{
+    switch (algorithm)
+    {
+        case Checksum::Crc32:
+            return "crc32";
+
+        case Checksum::Crc32c:
+            return "crc32c";
+
+        default:
+            return "xxhash64";
+    }
+}
+
+uint64_t oneShot(Checksum::Algorithm algorithm, const char *data, size_t size)
+{
+    switch (algorithm)
+    {
+        case Checksum::Crc32:
+            return Checksum::crc32(0, data, size);
+
+        case Checksum::Crc32c:
+            return Checksum::crc32c(0, data, size);
+
+        default:
+            return Checksum::xxHash64(data, size);
+    }
+}
+
+bool check(const Vector &vector)
+{
+    size_t size = std::strlen(vector.data);
+    Checksum checksum(vector.algorithm);
+    uint64_t value;
+
+    if ((value = oneShot(vector.algorithm, vector.data, size)) != vector.value)
+    {
+        std::fprintf(stderr, "%s(\"%s\") is %016llx, not %016llx\n", name(vector.algorithm), vector.data,
+                     static_cast<unsigned long long>(value), static_cast<unsigned long long>(vector.value));
+        return false;
+    }
+
+    /* Byte by byte, so that the buffered tails of xxHash64 are crossed too */
+    for (size_t i = 0; i < size; ++i)
+        checksum.update(vector.data + i, 1);
+
+    if ((value = checksum.value()) != vector.value)
+    {
+        std::fprintf(stderr, "%s(\"%s\") by bytes is %016llx, not %016llx\n", name(vector.algorithm), vector.data,
+                     static_cast<unsigned long long>(value), static_cast<unsigned long long>(vector.value));
+        return false;
+    }
+
+    checksum.reset();
+    checksum.update(vector.data, size);
+
+    if (checksum.value() != vector.value)
+    {
+        std::fprintf(stderr, "%s(\"%s\") after reset() differs\n", name(vector.algorithm), vector.data);
+        return false;
+    }
+
+    return true;
+}
+
+/* Static functions chain like zlib's crc32() */
+bool chain(Checksum::Algorithm algorithm)
+{
+    static const char data[] = "123456789";
+    uint32_t crc = algorithm == Checksum::Crc32 ? Checksum::crc32(0, data, 4) : Checksum::crc32c(0, data, 4);
+
+    crc = algorithm == Checksum::Crc32 ? Checksum::crc32(crc, data + 4, 5) : Checksum::crc32c(crc, data + 4, 5);
+
+    if (crc != oneShot(algorithm, data, 9))
+    {
+        std::fprintf(stderr, "%s doesn't chain\n", name(algorithm));
+        return false;
+    }
+
+    return true;
+}
+
+/* Longer than the slices and the stripes, with every tail length */
+bool lengths(Checksum::Algorithm algorithm)
+{
+    char data[1024];
+    Checksum checksum(algorithm);
+
+    for (size_t i = 0; i < sizeof(data); ++i)
+        data[i] = static_cast<char>(i * 7 + 3);
+
+    for (size_t size = 0; size <= sizeof(data); size += 13)
+    {
+        checksum.reset();
+        checksum.update(data, size / 3);
+        checksum.update(data + size / 3, size - size / 3);
+
+        if (checksum.value() != oneShot(algorithm, data, size))
+        {
+            std::fprintf(stderr, "%s of %zu bytes in two parts differs\n", name(algorithm), size);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}
+
+
+int main()
+{
+    bool res = true;
+
+    for (auto &i : vectors)
+        res = check(i) && res;
+
+    res = chain(Checksum::Crc32) && res;
+    res = chain(Checksum::Crc32c) && res;
+
+    res = lengths(Checksum::Crc32) && res;
+    res = lengths(Checksum::Crc32c) && res;
+    res = lengths(Checksum::XxHash64) && res;
+
+    return res ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,102 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lvfs/CompactListing>
+#include <lvfs/IEntry>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+
+
+namespace {
+using namespace LVFS;
+
+bool check(const CompactListing &listing, CompactListing::Index index, const char *expected)
+{
+    char buffer[64];
+
+    if (!listing.path(index, buffer, sizeof(buffer)) || std::strcmp(buffer, expected) != 0)
+    {
+        std::fprintf(stderr, "%s: path is not %s\n", listing.location(), expected);
+        return false;
+    }
+
+    /* Just enough for the terminator, and one byte less */
+    size_t size = std::strlen(expected) + 1;
+
+    if (!listing.path(index, buffer, size) || std::strcmp(buffer, expected) != 0 || listing.path(index, buffer, size - 1))
+    {
+        std::fprintf(stderr, "%s: %s doesn't fit exactly\n", listing.location(), expected);
+        return false;
+    }
+
+    return true;
+}
+
+/* "location" with "etc/fstab" under it gives "prefix" + "etc/fstab" */
+bool listing(const char *location, const char *prefix)
+{
+    CompactListing *listing = new CompactListing("file", location);
+    Interface::Holder holder(listing);
+    CompactListing::Index etc = listing->add(CompactListing::Root, "etc", DT_DIR, 0, 0, 0);
+    CompactListing::Index fstab = listing->add(etc, "fstab", DT_REG, 0, 10, 0);
+    char expected[64];
+
+    if (etc == CompactListing::Root || fstab == CompactListing::Root)
+    {
+        std::fprintf(stderr, "%s: add failed\n", location);
+        return false;
+    }
+
+    if (!check(*listing, CompactListing::Root, location))
+        return false;
+
+    std::snprintf(expected, sizeof(expected), "%setc", prefix);
+
+    if (!check(*listing, etc, expected))
+        return false;
+
+    Interface::Holder entry = listing->entry(etc);
+
+    if (!entry.isValid() || std::strcmp(entry->as<IEntry>()->location(), expected) != 0)
+    {
+        std::fprintf(stderr, "%s: proxy location is not %s\n", location, expected);
+        return false;
+    }
+
+    std::snprintf(expected, sizeof(expected), "%setc/fstab", prefix);
+    return check(*listing, fstab, expected);
+}
+
+}
+
+
+int main()
+{
+    if (!listing("/", "/") ||
+        !listing("/home/user", "/home/user/") ||
+        !listing("/home/user/", "/home/user/"))
+    {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
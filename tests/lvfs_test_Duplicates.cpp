@@ -0,0 +1,284 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lvfs/Duplicates>
+#include <lvfs/IEntry>
+#include <lvfs/IStream>
+#include <lvfs/IDirectory>
+#include <lvfs/IIdentity>
+#include <lvfs/IProperties>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+
+/*
+ * Trees of files in memory, so that the contents, hash collisions
+ * included, and the links are under control.
+ */
+namespace {
+using namespace LVFS;
+
+class MemoryStream : public Implements<IStream>
+{
+public:
+    MemoryStream(const std::string &data) :
+        m_data(data),
+        m_offset(0)
+    {}
+
+    virtual size_t read(void *buffer, size_t size)
+    {
+        size = std::min(size, m_data.size() - m_offset);
+        std::memcpy(buffer, m_data.data() + m_offset, size);
+        m_offset += size;
+        return size;
+    }
+
+    virtual size_t write(const void *buffer, size_t size)
+    {
+        m_lastError = Error(EBADF);
+        return 0;
+    }
+
+    virtual bool advise(off64_t offset, off64_t len, Advise advise)
+    {
+        return true;
+    }
+
+    virtual bool seek(off64_t offset, Whence whence)
+    {
+        if (whence == FromCurrent)
+            offset += m_offset;
+        else if (whence == FromEnd)
+            offset += m_data.size();
+
+        if (offset < 0 || offset > static_cast<off64_t>(m_data.size()))
+        {
+            m_lastError = Error(EINVAL);
+            return false;
+        }
+
+        m_offset = offset;
+        return true;
+    }
+
+    virtual bool flush()
+    {
+        return true;
+    }
+
+    virtual const Error &lastError() const
+    {
+        return m_lastError;
+    }
+
+private:
+    std::string m_data;
+    size_t m_offset;
+    Error m_lastError;
+};
+
+class MemoryFile : public Implements<IEntry, IProperties, IIdentity>
+{
+public:
+    MemoryFile(const char *title, const std::string &data, ino_t inode, nlink_t links = 1) :
+        m_title(title),
+        m_data(data),
+        m_inode(inode),
+        m_links(links)
+    {}
+
+    /* IEntry */
+
+    virtual const char *title() const { return m_title.c_str(); }
+    virtual const char *schema() const { return "memory"; }
+    virtual const char *location() const { return m_title.c_str(); }
+    virtual const IType *type() const { return NULL; }
+
+    virtual Interface::Holder open(IStream::Mode mode) const
+    {
+        return mode == IStream::Read ? Interface::Holder(new (std::nothrow) MemoryStream(m_data)) : Interface::Holder();
+    }
+
+    /* IProperties */
+
+    virtual off64_t size() const { return m_data.size(); }
+    virtual time_t cTime() const { return 0; }
+    virtual time_t mTime() const { return 0; }
+    virtual time_t aTime() const { return 0; }
+    virtual int permissions() const { return Read; }
+
+    /* IIdentity */
+
+    virtual dev_t device() const { return 1; }
+    virtual ino_t inode() const { return m_inode; }
+    virtual nlink_t links() const { return m_links; }
+
+private:
+    std::string m_title;
+    std::string m_data;
+    ino_t m_inode;
+    nlink_t m_links;
+};
+
+class MemoryDirectory : public Implements<IEntry, IDirectory>
+{
+public:
+    typedef ::EFC::List<Interface::Holder> Entries;
+
+public:
+    MemoryDirectory(const char *title) :
+        m_title(title)
+    {}
+
+    inline void add(const Interface::Holder &entry) { m_entries.push_back(entry); }
+
+    /* IEntry */
+
+    virtual const char *title() const { return m_title.c_str(); }
+    virtual const char *schema() const { return "memory"; }
+    virtual const char *location() const { return m_title.c_str(); }
+    virtual const IType *type() const { return NULL; }
+    virtual Interface::Holder open(IStream::Mode mode) const { return Interface::Holder(); }
+
+    /* IDirectory */
+
+    virtual const_iterator begin() const { return std_iterator<Entries>(m_entries.begin()); }
+    virtual const_iterator end() const { return std_iterator<Entries>(m_entries.end()); }
+
+    virtual bool exists(const char *name) const { return false; }
+    virtual Interface::Holder entry(const char *name, const IType *type, bool create) { return Interface::Holder(); }
+
+    virtual bool copy(const Progress &callback, const Interface::Holder &file, bool move) { return false; }
+    virtual bool rename(const Interface::Holder &file, const char *name) { return false; }
+    virtual bool remove(const Interface::Holder &file) { return false; }
+
+    virtual const Error &lastError() const { return m_lastError; }
+
+private:
+    std::string m_title;
+    Entries m_entries;
+    Error m_lastError;
+};
+
+/* Sorted titles of a group, separated by spaces */
+typedef ::EFC::List<std::string> Groups;
+
+void found(void *arg, const Duplicates::Entries &entries)
+{
+    std::vector<std::string> titles;
+    std::string group;
+
+    for (auto &i : entries)
+        titles.push_back(i->as<IEntry>()->title());
+
+    std::sort(titles.begin(), titles.end());
+
+    for (auto &i : titles)
+        group += group.empty() ? i : " " + i;
+
+    static_cast<Groups *>(arg)->push_back(group);
+}
+
+std::string pattern(size_t size, unsigned seed)
+{
+    std::string res(size, 0);
+
+    for (size_t i = 0; i < size; ++i)
+        res[i] = static_cast<char>(((i + seed) * 2654435761u) >> 11);
+
+    return res;
+}
+
+bool contains(const Groups &groups, const char *expected)
+{
+    return std::find(groups.begin(), groups.end(), expected) != groups.end();
+}
+
+}
+
+
+int main()
+{
+    /* Longer than both partial hashes together */
+    std::string big = pattern(5 * Duplicates::PartialSize, 1);
+    std::string middle = big;
+    std::string other = pattern(5 * Duplicates::PartialSize, 2);
+
+    /* Same head and tail, so equal partial hashes, different contents */
+    middle[middle.size() / 2] ^= 1;
+
+    MemoryDirectory *first = new MemoryDirectory("first");
+    MemoryDirectory *second = new MemoryDirectory("second");
+    MemoryDirectory *nested = new MemoryDirectory("nested");
+    Interface::Holder roots[] = { Interface::Holder(first), Interface::Holder(second) };
+    Interface::Holder sub(nested);
+    ino_t inode = 1;
+    ino_t linked = ++inode;
+
+    first->add(Interface::Holder(new MemoryFile("big1", big, linked, 2)));
+    first->add(Interface::Holder(new MemoryFile("small1", "hello\n", ++inode)));
+    first->add(Interface::Holder(new MemoryFile("empty1", "", ++inode)));
+    first->add(Interface::Holder(new MemoryFile("single", "only one of this size", ++inode)));
+    first->add(sub);
+
+    nested->add(Interface::Holder(new MemoryFile("big2", big, ++inode)));
+    nested->add(Interface::Holder(new MemoryFile("middle", middle, ++inode)));
+
+    /* Another link of big1 */
+    second->add(Interface::Holder(new MemoryFile("link", big, linked, 2)));
+    second->add(Interface::Holder(new MemoryFile("big3", big, ++inode)));
+    second->add(Interface::Holder(new MemoryFile("other", other, ++inode)));
+    second->add(Interface::Holder(new MemoryFile("small2", "hello\n", ++inode)));
+    second->add(Interface::Holder(new MemoryFile("small3", "hellp\n", ++inode)));
+    second->add(Interface::Holder(new MemoryFile("empty2", "", ++inode)));
+
+    Duplicates::Entries entries;
+    Groups groups;
+
+    for (auto &i : roots)
+        entries.push_back(i);
+
+    Duplicates duplicates(entries, &groups, found);
+
+    if (!duplicates.run())
+    {
+        std::fprintf(stderr, "run: %s\n", duplicates.lastError().description());
+        return EXIT_FAILURE;
+    }
+
+    /* One link stands for both, whichever is seen first */
+    if (groups.size() != 2 || !contains(groups, "small1 small2") ||
+        !(contains(groups, "big1 big2 big3") || contains(groups, "big2 big3 link")))
+    {
+        for (auto &i : groups)
+            std::fprintf(stderr, "unexpected group: %s\n", i.c_str());
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
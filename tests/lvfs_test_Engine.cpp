@@ -0,0 +1,350 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lvfs/copy/Engine>
+#include <lvfs/IDescriptor>
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+namespace {
+using namespace LVFS;
+
+class FileStream : public Implements<IStream, IDescriptor>
+{
+public:
+    FileStream(int fd) :
+        m_fd(fd)
+    {}
+
+    virtual ~FileStream()
+    {
+        ::close(m_fd);
+    }
+
+    virtual size_t read(void *buffer, size_t size)
+    {
+        ssize_t res = ::read(m_fd, buffer, size);
+
+        if (res < 0)
+        {
+            m_lastError = Error(errno);
+            return 0;
+        }
+
+        return res;
+    }
+
+    virtual size_t write(const void *buffer, size_t size)
+    {
+        ssize_t res = ::write(m_fd, buffer, size);
+
+        if (res < 0)
+        {
+            m_lastError = Error(errno);
+            return 0;
+        }
+
+        return res;
+    }
+
+    virtual bool advise(off64_t offset, off64_t len, Advise advise)
+    {
+        return true;
+    }
+
+    virtual bool seek(off64_t offset, Whence whence)
+    {
+        static const int whences[] = { SEEK_SET, SEEK_CUR, SEEK_END };
+
+        if (::lseek64(m_fd, offset, whences[whence]) < 0)
+        {
+            m_lastError = Error(errno);
+            return false;
+        }
+
+        return true;
+    }
+
+    virtual bool flush()
+    {
+        return true;
+    }
+
+    virtual const Error &lastError() const
+    {
+        return m_lastError;
+    }
+
+    virtual int descriptor() const
+    {
+        return m_fd;
+    }
+
+private:
+    int m_fd;
+    Error m_lastError;
+};
+
+enum
+{
+    FileSize = 3 * 1024 * 1024 + 123,
+    MaxSize = 4 * 1024 * 1024
+};
+
+const char *names[] =
+{
+    "none", "reflink", "copy_file_range", "sendfile", "splice",
+    "read/write", "parallel chunks", "sparse", "direct"
+};
+
+char directory[] = "/tmp/lvfs_test_Engine.XXXXXX";
+char source[PATH_MAX];
+char empty[PATH_MAX];
+char destination[PATH_MAX];
+
+void report(void *arg, off64_t processed)
+{}
+
+inline Interface::Holder stream(int fd)
+{
+    return fd < 0 ? Interface::Holder() : Interface::Holder(new (std::nothrow) FileStream(fd));
+}
+
+/* The whole file, -1 on failure */
+ssize_t contents(const char *path, char *buffer)
+{
+    ssize_t res = 0;
+    ssize_t read;
+    int fd;
+
+    if ((fd = ::open(path, O_RDONLY)) < 0)
+        return -1;
+
+    while ((read = ::read(fd, buffer + res, MaxSize - res)) > 0)
+        res += read;
+
+    ::close(fd);
+    return read < 0 ? -1 : res;
+}
+
+bool same(const char *path1, const char *path2)
+{
+    static char data1[MaxSize];
+    static char data2[MaxSize];
+    ssize_t size1 = contents(path1, data1);
+    ssize_t size2 = contents(path2, data2);
+
+    if (size1 < 0 || size1 != size2 || std::memcmp(data1, data2, size1) != 0)
+    {
+        std::fprintf(stderr, "%s differs from %s (%zd and %zd bytes)\n", path2, path1, size1, size2);
+        return false;
+    }
+
+    return true;
+}
+
+/* Copies a file by the given methods, unsupported tells whether it failed with ENOTSUP */
+bool copy(const char *from, unsigned methods, Copy::Engine::Method &method, bool &unsupported)
+{
+    static const volatile bool aborted = false;
+    const Copy::Statistics::Progress progress = { NULL, report, aborted };
+    Copy::Statistics statistics(progress);
+    Copy::Engine::Options options;
+
+    options.methods = methods;
+    Copy::Engine engine(statistics, options);
+
+    Interface::Holder src(stream(::open(from, O_RDONLY)));
+    Interface::Holder dst(stream(::open(destination, O_WRONLY | O_CREAT | O_TRUNC, 0644)));
+
+    if (!src.isValid() || !dst.isValid())
+    {
+        std::perror(from);
+        return false;
+    }
+
+    bool res = engine.copy(src, dst);
+
+    method = engine.method();
+    unsupported = !res && engine.lastError().code() == ENOTSUP;
+
+    if (!res && !unsupported)
+        std::fprintf(stderr, "copy of %s by 0x%x: %s\n", from, methods, engine.lastError().description());
+
+    return res;
+}
+
+/* With read()/write() allowed each method either copies or falls back */
+bool fallback(const char *from, Copy::Engine::Method first)
+{
+    unsigned methods = (1u << first) | (1u << Copy::Engine::ReadWrite);
+    Copy::Engine::Method method;
+    bool unsupported;
+
+    if (!copy(from, methods, method, unsupported) || !same(from, destination))
+    {
+        std::fprintf(stderr, "%s with fallback failed for %s\n", names[first], from);
+        return false;
+    }
+
+    if (method != first && method != Copy::Engine::ReadWrite)
+    {
+        std::fprintf(stderr, "%s copied %s by %s\n", names[first], from, names[method]);
+        return false;
+    }
+
+    return true;
+}
+
+/* Alone a method copies or fails with ENOTSUP, never anything else */
+bool alone(const char *from, Copy::Engine::Method only)
+{
+    Copy::Engine::Method method;
+    bool unsupported;
+
+    if (copy(from, 1u << only, method, unsupported))
+    {
+        if (method != only)
+        {
+            std::fprintf(stderr, "%s alone copied %s by %s\n", names[only], from, names[method]);
+            return false;
+        }
+
+        return same(from, destination);
+    }
+
+    return unsupported;
+}
+
+/* The kernel gives no size of procfs files, their end is the first empty read */
+bool procfs()
+{
+    Copy::Engine::Method method;
+    bool unsupported;
+
+    if (!copy("/proc/version", Copy::Engine::AllMethods, method, unsupported) || !same("/proc/version", destination))
+        return false;
+
+    struct stat st;
+
+    if (::stat(destination, &st) != 0 || st.st_size == 0)
+    {
+        std::fprintf(stderr, "/proc/version copied empty\n");
+        return false;
+    }
+
+    return true;
+}
+
+bool nothingAllowed()
+{
+    Copy::Engine::Method method;
+    bool unsupported;
+
+    if (copy(source, 0, method, unsupported) || !unsupported)
+    {
+        std::fprintf(stderr, "copy with no methods allowed didn't fail with ENOTSUP\n");
+        return false;
+    }
+
+    return true;
+}
+
+bool makeFiles()
+{
+    static char data[FileSize];
+    int fd;
+
+    if (::mkdtemp(directory) == NULL)
+        return false;
+
+    std::snprintf(source, sizeof(source), "%s/source", directory);
+    std::snprintf(empty, sizeof(empty), "%s/empty", directory);
+    std::snprintf(destination, sizeof(destination), "%s/destination", directory);
+
+    for (size_t i = 0; i < FileSize; ++i)
+        data[i] = static_cast<char>((i * 2654435761u) >> 13);
+
+    if ((fd = ::open(source, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        return false;
+
+    bool res = ::write(fd, data, FileSize) == FileSize;
+    ::close(fd);
+
+    if ((fd = ::open(empty, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        return false;
+
+    ::close(fd);
+    return res;
+}
+
+void removeFiles()
+{
+    ::unlink(source);
+    ::unlink(empty);
+    ::unlink(destination);
+    ::rmdir(directory);
+}
+
+}
+
+
+int main()
+{
+    static const Copy::Engine::Method methods[] =
+    {
+        Copy::Engine::Reflink,
+        Copy::Engine::CopyFileRange,
+        Copy::Engine::SendFile,
+        Copy::Engine::Splice,
+        Copy::Engine::ReadWrite
+    };
+
+    bool res = true;
+
+    if (!makeFiles())
+    {
+        std::perror("files");
+        removeFiles();
+        return EXIT_FAILURE;
+    }
+
+    for (auto i : methods)
+    {
+        res = fallback(source, i) && res;
+        res = fallback(empty, i) && res;
+        res = alone(source, i) && res;
+        res = alone(empty, i) && res;
+    }
+
+    res = procfs() && res;
+    res = nothingAllowed() && res;
+
+    removeFiles();
+    return res ? EXIT_SUCCESS : EXIT_FAILURE;
+}
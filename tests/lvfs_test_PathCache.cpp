@@ -0,0 +1,208 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lvfs/PathCache>
+
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+namespace {
+using namespace LVFS;
+
+char s_root[] = "/tmp/lvfs_test_PathCache.XXXXXX";
+
+/* "name" of directory "index" under the root, in a static buffer */
+const char *path(int index, const char *name)
+{
+    static char buffer[PATH_MAX];
+
+    std::snprintf(buffer, sizeof(buffer), "%s/%d/%s", s_root, index, name);
+    return buffer;
+}
+
+bool setUp()
+{
+    char target[PATH_MAX];
+
+    if (::mkdtemp(s_root) == NULL)
+        return false;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        if (::mkdir(path(i, ""), 0700) != 0)
+            return false;
+
+        int fd = ::open(path(i, "file"), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+        if (fd == -1)
+            return false;
+
+        ::close(fd);
+    }
+
+    std::strcpy(target, path(0, "file"));
+    return ::symlink(target, path(1, "link")) == 0;
+}
+
+void tearDown()
+{
+    ::unlink(path(1, "link"));
+
+    for (int i = 0; i < 4; ++i)
+    {
+        ::unlink(path(i, "file"));
+        ::rmdir(path(i, ""));
+    }
+
+    ::rmdir(s_root);
+}
+
+/* Opens "file" of directory "index", true if that was a cache hit */
+int open(int index, bool &hit)
+{
+    size_t hits = PathCache::hits();
+    size_t misses = PathCache::misses();
+    int fd = PathCache::open(path(index, "file"), O_RDONLY);
+
+    if (fd != -1)
+        ::close(fd);
+
+    hit = PathCache::hits() == hits + 1 && PathCache::misses() == misses;
+    return fd;
+}
+
+bool expect(int index, bool expected, const char *what)
+{
+    bool hit;
+
+    if (open(index, hit) == -1)
+    {
+        std::fprintf(stderr, "%s: open failed\n", what);
+        return false;
+    }
+
+    if (hit != expected)
+    {
+        std::fprintf(stderr, "%s: %s expected\n", what, expected ? "hit" : "miss");
+        return false;
+    }
+
+    return true;
+}
+
+bool ttl()
+{
+    PathCache::clear();
+    PathCache::setTtl(100);
+
+    if (!expect(0, false, "ttl: first open") ||
+        !expect(0, true, "ttl: second open"))
+    {
+        return false;
+    }
+
+    ::usleep(150 * 1000);
+
+    if (!expect(0, false, "ttl: stale directory"))
+        return false;
+
+    PathCache::invalidate(s_root);
+    return expect(0, false, "ttl: invalidated directory");
+}
+
+/* The oldest unused directories are closed first */
+bool eviction()
+{
+    PathCache::clear();
+    PathCache::setTtl(PathCache::DefaultTtl);
+    PathCache::setLimit(2);
+
+    for (int i = 0; i < 3; ++i)
+        if (!expect(i, false, "eviction: first open"))
+            return false;
+
+    return expect(2, true, "eviction: newest directory") &&
+           expect(1, true, "eviction: newer directory") &&
+           expect(0, false, "eviction: oldest directory");
+}
+
+bool resolve()
+{
+    char expected[PATH_MAX];
+    char buffer[PATH_MAX];
+
+    PathCache::clear();
+
+    if (::realpath(path(0, "file"), expected) == NULL)
+        return false;
+
+    for (int i = 0; i < 2; ++i)
+    {
+        size_t hits = PathCache::hits();
+
+        if (!PathCache::resolve(path(1, "link"), buffer, sizeof(buffer)) || std::strcmp(buffer, expected) != 0)
+        {
+            std::fprintf(stderr, "resolve: link is not resolved to %s\n", expected);
+            return false;
+        }
+
+        if ((PathCache::hits() == hits + 1) != (i == 1))
+        {
+            std::fprintf(stderr, "resolve: %s expected\n", i == 1 ? "hit" : "miss");
+            return false;
+        }
+    }
+
+    if (PathCache::resolve(path(1, "link"), buffer, std::strlen(expected)))
+    {
+        std::fprintf(stderr, "resolve: too small buffer is filled\n");
+        return false;
+    }
+
+    return true;
+}
+
+}
+
+
+int main()
+{
+    if (!setUp())
+    {
+        std::fprintf(stderr, "setUp: %s\n", std::strerror(errno));
+        tearDown();
+        return EXIT_FAILURE;
+    }
+
+    bool res = ttl() && eviction() && resolve();
+
+    PathCache::clear();
+    PathCache::setTtl(PathCache::DefaultTtl);
+    PathCache::setLimit(0);
+    tearDown();
+
+    return res ? EXIT_SUCCESS : EXIT_FAILURE;
+}
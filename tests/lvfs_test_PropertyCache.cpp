@@ -0,0 +1,189 @@
+/**
+ * This file is part of lvfs.
+ *
+ * Copyright (C) 2011-2023 Dmitriy Vilkov, <dav.daemon@gmail.com>
+ *
+ * lvfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * lvfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with lvfs. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <lvfs/PropertyCache>
+#include <lvfs/IEntry>
+#include <lvfs/IIdentity>
+#include <lvfs/IProperties>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+
+/*
+ * Files in memory counting how often their properties were asked for,
+ * so that a cache hit is told from a miss.
+ */
+namespace {
+using namespace LVFS;
+
+class MemoryFile : public Implements<IEntry, IProperties, IIdentity>
+{
+public:
+    MemoryFile(const char *title, ino_t inode, off64_t size, int &reads) :
+        m_title(title),
+        m_inode(inode),
+        m_size(size),
+        m_reads(reads)
+    {}
+
+    inline void resize(off64_t size) { m_size = size; }
+
+    /* IEntry */
+
+    virtual const char *title() const { return m_title.c_str(); }
+    virtual const char *schema() const { return "memory"; }
+    virtual const char *location() const { return m_title.c_str(); }
+    virtual const IType *type() const { return NULL; }
+    virtual Interface::Holder open(IStream::Mode mode) const { return Interface::Holder(); }
+
+    /* IProperties */
+
+    virtual off64_t size() const { ++m_reads; return m_size; }
+    virtual time_t cTime() const { return 0; }
+    virtual time_t mTime() const { return 0; }
+    virtual time_t aTime() const { return 0; }
+    virtual int permissions() const { return Read; }
+
+    /* IIdentity */
+
+    virtual dev_t device() const { return 1; }
+    virtual ino_t inode() const { return m_inode; }
+    virtual nlink_t links() const { return 1; }
+
+private:
+    std::string m_title;
+    ino_t m_inode;
+    off64_t m_size;
+    int &m_reads;
+};
+
+inline off64_t size(const Interface::Holder &entry)
+{
+    return entry->as<IProperties>()->size();
+}
+
+bool check(const char *what, bool condition)
+{
+    if (!condition)
+        std::fprintf(stderr, "%s\n", what);
+
+    return condition;
+}
+
+/* Entries of one file share one record, until it is stale or invalidated */
+bool ttl()
+{
+    int reads = 0;
+    MemoryFile *file = new MemoryFile("file", 1, 10, reads);
+    Interface::Holder original(file);
+    Interface::Holder first = PropertyCache::wrap(original);
+    Interface::Holder second = PropertyCache::wrap(Interface::Holder(new MemoryFile("link", 1, 10, reads)));
+
+    PropertyCache::clear();
+    PropertyCache::setTtl(100);
+
+    size_t hits = PropertyCache::hits();
+    size_t misses = PropertyCache::misses();
+
+    if (!check("ttl: wrong size", size(first) == 10 && size(second) == 10) ||
+        !check("ttl: one record is not shared", reads == 1 && PropertyCache::hits() == hits + 1 && PropertyCache::misses() == misses + 1))
+    {
+        return false;
+    }
+
+    file->resize(20);
+
+    if (!check("ttl: fresh record is refreshed", size(first) == 10 && reads == 1))
+        return false;
+
+    ::usleep(150 * 1000);
+
+    if (!check("ttl: stale record is not refreshed", size(first) == 20 && size(second) == 20 && reads == 2))
+        return false;
+
+    file->resize(30);
+    PropertyCache::invalidate(original);
+
+    return check("ttl: invalidated record is not refreshed", size(first) == 30 && reads == 3);
+}
+
+/* The least recently used records are dropped first */
+bool eviction()
+{
+    int reads[4] = {};
+    Interface::Holder files[4];
+
+    PropertyCache::clear();
+    PropertyCache::setTtl(PropertyCache::DefaultTtl);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        files[i] = PropertyCache::wrap(Interface::Holder(new MemoryFile("file", 100 + i, i, reads[i])));
+        size(files[i]);
+    }
+
+    size_t record = PropertyCache::used() / 3;
+    PropertyCache::setLimit(3 * record);
+
+    if (!check("eviction: records are dropped under the limit", PropertyCache::used() == 3 * record))
+        return false;
+
+    /* The first one becomes the most recently used, the second one the least */
+    size(files[0]);
+
+    files[3] = PropertyCache::wrap(Interface::Holder(new MemoryFile("file", 103, 3, reads[3])));
+    size(files[3]);
+
+    if (!check("eviction: limit is exceeded", PropertyCache::used() == 3 * record))
+        return false;
+
+    size(files[0]);
+    size(files[2]);
+    size(files[3]);
+
+    if (!check("eviction: recently used record is dropped", reads[0] == 1 && reads[2] == 1 && reads[3] == 1))
+        return false;
+
+    size(files[1]);
+
+    if (!check("eviction: least recently used record is kept", reads[1] == 2))
+        return false;
+
+    PropertyCache::setLimit(record);
+
+    return check("eviction: lowered limit is not applied", PropertyCache::used() == record);
+}
+
+}
+
+
+int main()
+{
+    bool res = ttl() && eviction();
+
+    PropertyCache::setLimit(PropertyCache::DefaultLimit);
+    PropertyCache::setTtl(PropertyCache::DefaultTtl);
+    PropertyCache::clear();
+
+    return res ? EXIT_SUCCESS : EXIT_FAILURE;
+}